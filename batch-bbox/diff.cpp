@@ -0,0 +1,375 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+#include "bbox.h"
+#include "diff.h"
+#include "trace.h"
+
+typedef struct _EngineBoxes {
+  int status;
+  Box document;
+  std::vector<Box> elements;
+} EngineBoxes;
+
+typedef struct _BoxDiff {
+  int element; /* -1 for the document box */
+  bool matched; /* false if only one engine drew the element */
+  double iou;
+  double dx0;
+  double dy0;
+  double dx1;
+  double dy1;
+} BoxDiff;
+
+typedef struct _PairDiff {
+  BBoxEngine a;
+  BBoxEngine b;
+  size_t elements_a;
+  size_t elements_b;
+  bool matched; /* false if the element lists don't line up by draw index */
+  BoxDiff document;
+  std::vector<BoxDiff> elements;
+} PairDiff;
+
+typedef struct _FileDiff {
+  EngineBoxes engines[BBOX_ENGINE_COUNT];
+  std::vector<PairDiff> pairs;
+} FileDiff;
+
+typedef struct _Offender {
+  size_t file;
+  size_t pair;
+  BoxDiff diff;
+} Offender;
+
+typedef struct _DiffBatch {
+  std::vector<std::string> files;
+  std::vector<FileDiff> results;
+  std::atomic<size_t> next;
+  double threshold;
+} DiffBatch;
+
+double boxArea(Box box)
+{
+  if (boxIsEmpty(box))
+    return 0;
+  return (box.x1 - box.x0) * (box.y1 - box.y0);
+}
+
+/* Two empty boxes agree; an empty box never overlaps a non-empty one. */
+BoxDiff compareBoxes(int element, Box a, Box b)
+{
+  BoxDiff diff = {element, true, 0, 0, 0, 0, 0};
+  bool empty_a = boxIsEmpty(a), empty_b = boxIsEmpty(b);
+  if (empty_a || empty_b)
+  {
+    diff.iou = (empty_a && empty_b) ? 1 : 0;
+    return diff;
+  }
+  diff.dx0 = b.x0 - a.x0;
+  diff.dy0 = b.y0 - a.y0;
+  diff.dx1 = b.x1 - a.x1;
+  diff.dy1 = b.y1 - a.y1;
+  double intersection = boxArea(boxIntersect(a, b));
+  double area_union = boxArea(a) + boxArea(b) - intersection;
+  if (area_union > 0)
+    diff.iou = intersection / area_union;
+  else
+    /* Degenerate boxes (lines, points) have no area, so fall back to equality. */
+    diff.iou = (diff.dx0 == 0 && diff.dy0 == 0 && diff.dx1 == 0 && diff.dy1 == 0) ? 1 : 0;
+  return diff;
+}
+
+/* Elements are keyed by draw index, with an empty box for a call that drew
+ * nothing, so two lists of different lengths can't be paired at all and the
+ * pair is reported as unmatched. An element only one engine drew is reported
+ * as unmatched rather than given an IoU. Only disagreements below the
+ * threshold are stored so the report stays small on large datasets. */
+PairDiff comparePair(BBoxEngine a, BBoxEngine b, EngineBoxes *boxes_a, EngineBoxes *boxes_b, double threshold)
+{
+  PairDiff pair;
+  pair.a = a;
+  pair.b = b;
+  pair.elements_a = boxes_a->elements.size();
+  pair.elements_b = boxes_b->elements.size();
+  pair.matched = threshold < 0 || pair.elements_a == pair.elements_b;
+  pair.document = compareBoxes(-1, boxes_a->document, boxes_b->document);
+  if (threshold < 0 || !pair.matched)
+    return pair;
+
+  for (size_t i = 0; i < pair.elements_a; i++)
+  {
+    Box box_a = boxes_a->elements[i], box_b = boxes_b->elements[i];
+    BoxDiff diff = compareBoxes((int)i, box_a, box_b);
+    if (boxIsEmpty(box_a) != boxIsEmpty(box_b))
+      diff.matched = false;
+    if (!diff.matched || diff.iou < threshold)
+      pair.elements.push_back(diff);
+  }
+  return pair;
+}
+
+void diffWorker(DiffBatch *batch)
+{
+  traceSetThreadName("diff worker");
+  BBoxWorker bbox_worker;
+  initializeBBoxWorker(&bbox_worker);
+
+  while (1)
+  {
+    size_t i = batch->next.fetch_add(1);
+    if (i >= batch->files.size())
+      break;
+    TRACE_SCOPE("diffTask");
+    FileDiff *result = &batch->results[i];
+
+    SVGFile svg_file;
+    int status = openSVGFile(batch->files[i], &svg_file);
+    if (status == 0 && snapshotsEnabled())
+      loadSnapshot(&svg_file, batch->files[i]);
+    for (int e = 0; e < BBOX_ENGINE_COUNT; e++)
+    {
+      EngineBoxes *boxes = &result->engines[e];
+      boxes->document = emptyBox();
+      boxes->status = status ? status : calculateBoundingBoxes(&bbox_worker, (BBoxEngine)e, &svg_file, &boxes->document, &boxes->elements);
+    }
+    if (status == 0)
+      closeSVGFile(&svg_file);
+
+    for (int a = 0; a < BBOX_ENGINE_COUNT; a++)
+    {
+      for (int b = a + 1; b < BBOX_ENGINE_COUNT; b++)
+      {
+        EngineBoxes *boxes_a = &result->engines[a], *boxes_b = &result->engines[b];
+        if (boxes_a->status || boxes_b->status)
+          continue;
+        /* Engines with only a document box have no elements to pair. */
+        bool has_elements = bboxEngineHasElements((BBoxEngine)a) && bboxEngineHasElements((BBoxEngine)b);
+        PairDiff pair = comparePair((BBoxEngine)a, (BBoxEngine)b, boxes_a, boxes_b, has_elements ? batch->threshold : -1);
+        result->pairs.push_back(pair);
+      }
+    }
+  }
+}
+
+void printJSONString(std::string const& text)
+{
+  putchar('"');
+  for (char c: text)
+  {
+    if (c == '"' || c == '\\')
+      printf("\\%c", c);
+    else if ((unsigned char)c < 0x20)
+      printf("\\u%04x", c);
+    else
+      putchar(c);
+  }
+  putchar('"');
+}
+
+void printJSONBoxDiff(BoxDiff const& diff)
+{
+  if (!diff.matched)
+  {
+    printf("{\"element\": %d, \"unmatched\": true}", diff.element);
+    return;
+  }
+  printf("{\"element\": %d, \"iou\": %.6f, \"dx0\": %.3f, \"dy0\": %.3f, \"dx1\": %.3f, \"dy1\": %.3f}",
+         diff.element, diff.iou, diff.dx0, diff.dy0, diff.dx1, diff.dy1);
+}
+
+void printJSONReport(DiffBatch *batch, std::vector<Offender> const& worst)
+{
+  printf("{\n  \"threshold\": %f,\n  \"files\": [", batch->threshold);
+  for (size_t i = 0; i < batch->files.size(); i++)
+  {
+    FileDiff *result = &batch->results[i];
+    printf(i ? ",\n    {\"file\": " : "\n    {\"file\": ");
+    printJSONString(batch->files[i]);
+    printf(", \"engines\": {");
+    for (int e = 0; e < BBOX_ENGINE_COUNT; e++)
+    {
+      EngineBoxes *boxes = &result->engines[e];
+      printf("%s\"%s\": ", e ? ", " : "", bboxEngineName((BBoxEngine)e));
+      /* An empty document box is infinite, which JSON can't hold. */
+      if (boxes->status)
+        printf("\"error\"");
+      else if (boxIsEmpty(boxes->document))
+        printf("{\"document\": null, \"elements\": %zu}", boxes->elements.size());
+      else
+        printf("{\"document\": [%.3f, %.3f, %.3f, %.3f], \"elements\": %zu}",
+               boxes->document.x0, boxes->document.y0, boxes->document.x1, boxes->document.y1, boxes->elements.size());
+    }
+    printf("},\n     \"pairs\": [");
+    for (size_t p = 0; p < result->pairs.size(); p++)
+    {
+      PairDiff const& pair = result->pairs[p];
+      printf("%s\n       {\"a\": \"%s\", \"b\": \"%s\", \"elements_a\": %zu, \"elements_b\": %zu, \"matched\": %s, \"document\": ",
+             p ? "," : "", bboxEngineName(pair.a), bboxEngineName(pair.b), pair.elements_a, pair.elements_b,
+             pair.matched ? "true" : "false");
+      printJSONBoxDiff(pair.document);
+      printf(", \"elements\": [");
+      for (size_t d = 0; d < pair.elements.size(); d++)
+      {
+        printf(d ? ", " : "");
+        printJSONBoxDiff(pair.elements[d]);
+      }
+      printf("]}");
+    }
+    printf("]}");
+  }
+  printf("\n  ],\n  \"worst\": [");
+  for (size_t i = 0; i < worst.size(); i++)
+  {
+    PairDiff const& pair = batch->results[worst[i].file].pairs[worst[i].pair];
+    printf("%s\n    {\"file\": ", i ? "," : "");
+    printJSONString(batch->files[worst[i].file]);
+    printf(", \"a\": \"%s\", \"b\": \"%s\", \"diff\": ", bboxEngineName(pair.a), bboxEngineName(pair.b));
+    printJSONBoxDiff(worst[i].diff);
+    printf("}");
+  }
+  printf("\n  ]\n}\n");
+}
+
+/* A quoted CSV field, with embedded quotes doubled. */
+void printCSVString(std::string const& text)
+{
+  putchar('"');
+  for (char c: text)
+  {
+    if (c == '"')
+      putchar('"');
+    putchar(c);
+  }
+  putchar('"');
+}
+
+/* One row per document comparison and per element disagreement, with
+ * "unmatched" in place of the element or the IoU where the lists or an
+ * element couldn't be paired. The worst
+ * offenders go to stderr so stdout stays a single table. */
+void printCSVReport(DiffBatch *batch, std::vector<Offender> const& worst)
+{
+  printf("file,a,b,element,iou,dx0,dy0,dx1,dy1\n");
+  for (size_t i = 0; i < batch->files.size(); i++)
+  {
+    FileDiff *result = &batch->results[i];
+    for (int e = 0; e < BBOX_ENGINE_COUNT; e++)
+    {
+      if (!result->engines[e].status)
+        continue;
+      printCSVString(batch->files[i]);
+      printf(",%s,,error,,,,,\n", bboxEngineName((BBoxEngine)e));
+    }
+    for (auto const& pair: result->pairs)
+    {
+      printCSVString(batch->files[i]);
+      printf(",%s,%s,document,%.6f,%.3f,%.3f,%.3f,%.3f\n",
+             bboxEngineName(pair.a), bboxEngineName(pair.b), pair.document.iou,
+             pair.document.dx0, pair.document.dy0, pair.document.dx1, pair.document.dy1);
+      if (!pair.matched)
+      {
+        printCSVString(batch->files[i]);
+        printf(",%s,%s,unmatched,,,,,\n", bboxEngineName(pair.a), bboxEngineName(pair.b));
+      }
+      for (auto const& diff: pair.elements)
+      {
+        printCSVString(batch->files[i]);
+        if (!diff.matched)
+        {
+          printf(",%s,%s,%d,unmatched,,,,\n", bboxEngineName(pair.a), bboxEngineName(pair.b), diff.element);
+          continue;
+        }
+        printf(",%s,%s,%d,%.6f,%.3f,%.3f,%.3f,%.3f\n",
+               bboxEngineName(pair.a), bboxEngineName(pair.b), diff.element, diff.iou,
+               diff.dx0, diff.dy0, diff.dx1, diff.dy1);
+      }
+    }
+  }
+
+  fprintf(stderr, "worst offenders:\n");
+  for (auto const& offender: worst)
+  {
+    PairDiff const& pair = batch->results[offender.file].pairs[offender.pair];
+    fprintf(stderr, "  %.4f  %s vs %s  %s  %s\n", offender.diff.iou, bboxEngineName(pair.a), bboxEngineName(pair.b),
+            batch->files[offender.file].c_str(), offender.diff.element < 0 ? "document" : std::to_string(offender.diff.element).c_str());
+  }
+}
+
+int runDiff(int argc, char **argv)
+{
+  DiffBatch batch;
+  batch.threshold = 0.99;
+  bool json = true;
+  size_t worst_count = 25;
+  int threads = std::thread::hardware_concurrency();
+  std::string path;
+
+  for (int i = 0; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--csv") == 0)
+      json = false;
+    else if (strcmp(argv[i], "--json") == 0)
+      json = true;
+    else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+      batch.threshold = atof(argv[++i]);
+    else if (strcmp(argv[i], "--worst") == 0 && i + 1 < argc)
+      worst_count = atoi(argv[++i]);
+    else if (path.empty())
+      path = argv[i];
+    else
+      threads = atoi(argv[i]);
+  }
+  if (path.empty())
+  {
+    fprintf(stderr, "usage: batch-bbox --diff [--json|--csv] [--threshold iou] [--worst n] <file-or-directory> [threads]\n");
+    return 1;
+  }
+  if (threads < 1)
+    threads = 1;
+
+  collectSVGFiles(path, &batch.files);
+  batch.results.resize(batch.files.size());
+  batch.next = 0;
+
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; i++)
+    pool.push_back(std::thread(diffWorker, &batch));
+  for (auto& thread: pool)
+    thread.join();
+
+  std::vector<Offender> worst;
+  int disagreements = 0;
+  for (size_t i = 0; i < batch.results.size(); i++)
+  {
+    for (size_t p = 0; p < batch.results[i].pairs.size(); p++)
+    {
+      PairDiff const& pair = batch.results[i].pairs[p];
+      if (pair.document.iou < batch.threshold)
+      {
+        worst.push_back({i, p, pair.document});
+        disagreements++;
+      }
+      /* Unmatched elements have no IoU to rank. */
+      for (auto const& diff: pair.elements)
+        if (diff.matched)
+          worst.push_back({i, p, diff});
+    }
+  }
+  size_t keep = std::min(worst_count, worst.size());
+  std::partial_sort(worst.begin(), worst.begin() + keep, worst.end(),
+                    [](Offender const& x, Offender const& y) { return x.diff.iou < y.diff.iou; });
+  worst.resize(keep);
+
+  if (json)
+    printJSONReport(&batch, worst);
+  else
+    printCSVReport(&batch, worst);
+
+  return disagreements ? 1 : 0;
+}
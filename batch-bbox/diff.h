@@ -0,0 +1,9 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+/* Headless differential mode: every engine computes the document box and
+ * the per-element boxes of each file, and the boxes are compared pairwise.
+ * Takes the arguments that follow --diff. */
+int runDiff(int argc, char **argv);
+
+#endif
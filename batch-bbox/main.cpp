@@ -0,0 +1,110 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstring>
+
+#include "bbox.h"
+#include "diff.h"
+#include "trace.h"
+
+typedef struct _BBoxResult {
+  int status;
+  double x0;
+  double y0;
+  double width;
+  double height;
+} BBoxResult;
+
+typedef struct _Batch {
+  std::vector<std::string> files;
+  std::vector<BBoxResult> results;
+  std::atomic<size_t> next;
+  BBoxEngine engine;
+} Batch;
+
+void worker(Batch *batch)
+{
+  traceSetThreadName("bbox worker");
+  BBoxWorker bbox_worker;
+  initializeBBoxWorker(&bbox_worker);
+
+  while (1)
+  {
+    size_t i = batch->next.fetch_add(1);
+    if (i >= batch->files.size())
+      break;
+    TRACE_SCOPE("bboxTask");
+    BBoxResult *result = &batch->results[i];
+    result->status = calculateBoundingBox(&bbox_worker, batch->engine, batch->files[i],
+                                          &result->x0, &result->y0, &result->width, &result->height);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  /* SVG_TRACE=<file.json> records a Chrome trace of the run. */
+  traceInitialize(getenv("SVG_TRACE"));
+  traceSetThreadName("main");
+  /* SVG_SNAPSHOTS=<directory> keeps a pre-parsed snapshot of every file
+   * there and reuses it while the file is unchanged. */
+  snapshotInitialize(getenv("SVG_SNAPSHOTS"));
+
+  if (argc > 1 && strcmp(argv[1], "--diff") == 0)
+  {
+    int status = runDiff(argc - 2, argv + 2);
+    traceFlush();
+    return status;
+  }
+
+  if (argc < 2 || argc > 4)
+  {
+    fprintf(stderr, "usage: %s <file-or-directory> [skia|cairo|geometry|librsvg|raster] [threads]\n", argv[0]);
+    fprintf(stderr, "       %s --diff [--json|--csv] [--threshold iou] [--worst n] <file-or-directory> [threads]\n", argv[0]);
+    return 1;
+  }
+
+  Batch batch;
+  batch.engine = BBOX_SKIA;
+  if (argc > 2 && strcmp(argv[2], "cairo") == 0)
+    batch.engine = BBOX_CAIRO;
+  else if (argc > 2 && strcmp(argv[2], "geometry") == 0)
+    batch.engine = BBOX_GEOMETRY;
+  else if (argc > 2 && strcmp(argv[2], "librsvg") == 0)
+    batch.engine = BBOX_LIBRSVG;
+  else if (argc > 2 && strcmp(argv[2], "raster") == 0)
+    batch.engine = BBOX_RASTER;
+
+  int threads = std::thread::hardware_concurrency();
+  if (argc > 3)
+    threads = atoi(argv[3]);
+  if (threads < 1)
+    threads = 1;
+
+  collectSVGFiles(std::string(argv[1]), &batch.files);
+  batch.results.resize(batch.files.size());
+  batch.next = 0;
+
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; i++)
+    pool.push_back(std::thread(worker, &batch));
+  for (auto& thread: pool)
+    thread.join();
+
+  int failed = 0;
+  for (size_t i = 0; i < batch.files.size(); i++)
+  {
+    BBoxResult *result = &batch.results[i];
+    if (result->status != 0)
+    {
+      printf("%s\terror\n", batch.files[i].c_str());
+      failed++;
+      continue;
+    }
+    printf("%s\t%f\t%f\t%f\t%f\n", batch.files[i].c_str(), result->x0, result->y0, result->width, result->height);
+  }
+
+  traceFlush();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+#include <cairo.h>
+
+#include <svgnative/SVGDocument.h>
+
+#include "bbox.h"
+#include "svg-file.h"
+#include "SnapshotSVGRenderer.h"
+#include "trace.h"
+
+/* Every malloc in the process goes through here so allocations can be
+ * counted, including the ones made inside cairo, librsvg and glib. */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static std::atomic<size_t> allocation_count(0);
+
+void *malloc(size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+
+typedef struct _Bench {
+  BBoxWorker worker;
+  int warmup;
+  int iterations;
+} Bench;
+
+typedef int (*Strategy)(Bench *bench, SVGFile *svg_file);
+
+int strategyParse(Bench *bench, SVGFile *svg_file)
+{
+  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_file->data, bench->worker.cairo_bounds_renderer));
+  return doc ? 0 : 1;
+}
+
+/* What a snapshot costs in place of parsing: checking it and creating the
+ * port's paths, transforms and styles from it. */
+int strategySnapshot(Bench *bench, SVGFile *svg_file)
+{
+  auto doc = std::unique_ptr<SVGNative::SnapshotDocument>(SVGNative::SnapshotDocument::CreateSnapshotDocument(&svg_file->snapshot, bench->worker.cairo_bounds_renderer));
+  return doc ? 0 : 1;
+}
+
+int strategyCairo(Bench *bench, SVGFile *svg_file)
+{
+  double x0, y0, width, height;
+  return calculateBoundingBoxCairo(&bench->worker, svg_file, &x0, &y0, &width, &height);
+}
+
+int strategySkia(Bench *bench, SVGFile *svg_file)
+{
+  double x0, y0, width, height;
+  return calculateBoundingBoxSkia(&bench->worker, svg_file, &x0, &y0, &width, &height);
+}
+
+int strategyGeometry(Bench *bench, SVGFile *svg_file)
+{
+  double x0, y0, width, height;
+  return calculateBoundingBoxGeometry(&bench->worker, svg_file, &x0, &y0, &width, &height);
+}
+
+int strategyLibrsvg(Bench *bench, SVGFile *svg_file)
+{
+  double x0, y0, width, height;
+  return calculateBoundingBoxLibrsvg(&bench->worker, svg_file, &x0, &y0, &width, &height);
+}
+
+int strategyRasterScan(Bench *bench, SVGFile *svg_file)
+{
+  double x0, y0, width, height;
+  return calculateBoundingBoxRaster(&bench->worker, svg_file, &x0, &y0, &width, &height);
+}
+
+/* Parses and renders the whole document with SNV + Cairo into an image the
+ * size of the document, the cost the bbox strategies are trying to avoid. */
+int strategyRender(Bench *bench, SVGFile *svg_file)
+{
+  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_file->data, bench->worker.cairo_renderer));
+  if (!doc)
+    return 1;
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, doc->Width(), doc->Height());
+  cairo_t *cr = cairo_create(surface);
+  bench->worker.cairo_renderer->SetCairo(cr);
+  doc->Render();
+  cairo_destroy(cr);
+  cairo_surface_flush(surface);
+  cairo_surface_destroy(surface);
+  return 0;
+}
+
+typedef struct _StrategyEntry {
+  const char *name;
+  Strategy run;
+} StrategyEntry;
+
+static const StrategyEntry strategies[] = {
+  {"parse", strategyParse},
+  {"snapshot", strategySnapshot},
+  {"cairo-ink-extents", strategyCairo},
+  {"skia-picture-rtree", strategySkia},
+  {"geometry", strategyGeometry},
+  {"librsvg-geometry", strategyLibrsvg},
+  {"raster-scan", strategyRasterScan},
+  {"render", strategyRender},
+};
+
+/* Resets the kernel's peak RSS counter (VmHWM) so it can be read per run. */
+void resetPeakRSS()
+{
+  FILE *clear_refs = fopen("/proc/self/clear_refs", "w");
+  if (clear_refs)
+  {
+    fputs("5", clear_refs);
+    fclose(clear_refs);
+  }
+}
+
+long readPeakRSS()
+{
+  FILE *status = fopen("/proc/self/status", "r");
+  if (!status)
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+  }
+  char line[256];
+  long peak = -1;
+  while (fgets(line, sizeof(line), status))
+  {
+    if (strncmp(line, "VmHWM:", 6) == 0)
+    {
+      peak = atol(line + 6);
+      break;
+    }
+  }
+  fclose(status);
+  return peak;
+}
+
+double percentile(std::vector<double> const& sorted, double p)
+{
+  size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void benchFile(Bench *bench, std::string filename)
+{
+  SVGFile svg_file;
+  if (openSVGFile(filename, &svg_file))
+  {
+    printf("%s\t-\t0\t-\t-\t-\t-\t-\terror\n", filename.c_str());
+    return;
+  }
+  /* With snapshots on, every strategy but parse and render replays the
+   * snapshot, and the snapshot strategy is only run when there is one. */
+  bool has_snapshot = snapshotsEnabled() && loadSnapshot(&svg_file, filename) == 0;
+
+  for (auto const& strategy: strategies)
+  {
+    if (strategy.run == strategySnapshot && !has_snapshot)
+      continue;
+    int status = 0;
+    for (int i = 0; i < bench->warmup; i++)
+      status |= strategy.run(bench, &svg_file);
+
+    std::vector<double> times;
+    resetPeakRSS();
+    size_t allocations_before = allocation_count.load();
+    for (int i = 0; i < bench->iterations; i++)
+    {
+      auto start = std::chrono::steady_clock::now();
+      status |= strategy.run(bench, &svg_file);
+      auto end = std::chrono::steady_clock::now();
+      times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    size_t allocations = allocation_count.load() - allocations_before;
+    long peak_rss = readPeakRSS();
+
+    std::sort(times.begin(), times.end());
+    printf("%s\t%s\t%d\t%.1f\t%.1f\t%.1f\t%.1f\t%ld\t%s\n", filename.c_str(), strategy.name, bench->iterations,
+           times.front(), percentile(times, 0.5), percentile(times, 0.99),
+           (double)allocations / bench->iterations, peak_rss, status ? "error" : "ok");
+    fflush(stdout);
+  }
+
+  closeSVGFile(&svg_file);
+}
+
+int main(int argc, char** argv)
+{
+  /* SVG_TRACE=<file.json> records a Chrome trace of the run. */
+  traceInitialize(getenv("SVG_TRACE"));
+  traceSetThreadName("main");
+  /* SVG_SNAPSHOTS=<directory> benchmarks against pre-parsed snapshots kept
+   * there. */
+  snapshotInitialize(getenv("SVG_SNAPSHOTS"));
+
+  Bench bench;
+  bench.warmup = 3;
+  bench.iterations = 50;
+  initializeBBoxWorker(&bench.worker);
+
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      bench.iterations = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+      bench.warmup = atoi(argv[++i]);
+    else
+      collectSVGFiles(std::string(argv[i]), &files);
+  }
+  if (bench.iterations < 1)
+    bench.iterations = 1;
+  if (files.empty())
+  {
+    collectSVGFiles("../dataset", &files);
+    collectSVGFiles("../svg-docs", &files);
+  }
+
+  printf("file\tstrategy\titerations\tmin_us\tmedian_us\tp99_us\tallocs_per_iter\tpeak_rss_kb\tstatus\n");
+  for (auto const& filename: files)
+    benchFile(&bench, filename);
+
+  traceFlush();
+  return 0;
+}
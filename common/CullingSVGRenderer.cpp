@@ -0,0 +1,116 @@
+#include "CullingSVGRenderer.h"
+
+namespace SVGNative
+{
+CullingSVGRenderer::CullingSVGRenderer(std::shared_ptr<SVGRenderer> renderer)
+    : mRenderer{renderer}
+    , mCulling{false}
+    , mViewport(emptyBox())
+    , mDraw{0}
+    , mGroup{0}
+    , mCulledDepth{0}
+    , mCulledDraws{0}
+{
+}
+
+void CullingSVGRenderer::SetBounds(const std::vector<Box>& drawBounds, const std::vector<Box>& groupBounds)
+{
+    mDrawBounds = drawBounds;
+    mGroupBounds = groupBounds;
+}
+
+void CullingSVGRenderer::BeginCulling(Box viewport)
+{
+    mCulling = true;
+    mViewport = viewport;
+    mDraw = 0;
+    mGroup = 0;
+    mCulledDepth = 0;
+    mCulledDraws = 0;
+}
+
+void CullingSVGRenderer::EndCulling()
+{
+    if (mDraw != mDrawBounds.size() || mGroup != mGroupBounds.size())
+    {
+        mDrawBounds.clear();
+        mGroupBounds.clear();
+    }
+    mCulling = false;
+}
+
+/* Boxes past the end, and empty ones, are drawn: culling only ever drops
+ * what is known to be off screen. */
+bool CullingSVGRenderer::Visible(const std::vector<Box>& bounds, size_t index) const
+{
+    if (!mCulling || index >= bounds.size() || boxIsEmpty(bounds[index]))
+        return true;
+    const Box& box = bounds[index];
+    return box.x0 <= mViewport.x1 && mViewport.x0 <= box.x1 && box.y0 <= mViewport.y1 && mViewport.y0 <= box.y1;
+}
+
+bool CullingSVGRenderer::Skip()
+{
+    bool skip = mCulledDepth > 0 || !Visible(mDrawBounds, mDraw);
+    mDraw++;
+    if (skip)
+        mCulledDraws++;
+    return skip;
+}
+
+void CullingSVGRenderer::SkipDraw()
+{
+    mDraw++;
+}
+
+std::unique_ptr<ImageData> CullingSVGRenderer::CreateImageData(const std::string& base64, ImageEncoding encoding)
+{
+    return mRenderer->CreateImageData(base64, encoding);
+}
+
+std::unique_ptr<Path> CullingSVGRenderer::CreatePath()
+{
+    return mRenderer->CreatePath();
+}
+
+std::unique_ptr<Transform> CullingSVGRenderer::CreateTransform(float a, float b, float c, float d, float tx, float ty)
+{
+    return mRenderer->CreateTransform(a, b, c, d, tx, ty);
+}
+
+void CullingSVGRenderer::Save(const GraphicStyle& graphicStyle)
+{
+    size_t group = mGroup++;
+    if (mCulledDepth > 0 || !Visible(mGroupBounds, group))
+    {
+        mCulledDepth++;
+        return;
+    }
+    mRenderer->Save(graphicStyle);
+}
+
+void CullingSVGRenderer::Restore()
+{
+    if (mCulledDepth > 0)
+    {
+        mCulledDepth--;
+        return;
+    }
+    mRenderer->Restore();
+}
+
+void CullingSVGRenderer::DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle)
+{
+    if (Skip())
+        return;
+    mRenderer->DrawPath(path, graphicStyle, fillStyle, strokeStyle);
+}
+
+void CullingSVGRenderer::DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea)
+{
+    if (Skip())
+        return;
+    mRenderer->DrawImage(image, graphicStyle, clipArea, fillArea);
+}
+
+} // namespace SVGNative
@@ -0,0 +1,67 @@
+#ifndef CULLING_SVG_RENDERER_H
+#define CULLING_SVG_RENDERER_H
+
+#include <vector>
+
+#include <svgnative/SVGRenderer.h>
+
+#include "geometry.h"
+
+/* Wraps another SVGNative port and drops the draw calls and whole groups
+ * whose box misses the viewport, so that a zoomed in view only rasterizes
+ * what is on screen. The boxes come from GeometrySVGRenderer walking the same
+ * document once: the document makes the same sequence of Save() and draw
+ * calls every time it renders, so the n-th call here is the n-th box there.
+ * A culled group is skipped with everything inside it, Save() and Restore()
+ * included. */
+
+namespace SVGNative
+{
+class CullingSVGRenderer final : public SVGRenderer
+{
+public:
+    explicit CullingSVGRenderer(std::shared_ptr<SVGRenderer> renderer);
+
+    std::unique_ptr<ImageData> CreateImageData(const std::string& base64, ImageEncoding encoding) override;
+    std::unique_ptr<Path> CreatePath() override;
+    std::unique_ptr<Transform> CreateTransform(float a = 1.0, float b = 0.0, float c = 0.0, float d = 1.0, float tx = 0.0, float ty = 0.0) override;
+
+    void Save(const GraphicStyle& graphicStyle) override;
+    void Restore() override;
+
+    void DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle) override;
+    void DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea) override;
+
+    /* GeometrySVGRenderer::DrawBounds() and GroupBounds() of the document. */
+    void SetBounds(const std::vector<Box>& drawBounds, const std::vector<Box>& groupBounds);
+    /* Culls against `viewport`, in the same space as the boxes, until
+     * EndCulling(). Call right around SVGDocument::Render(). */
+    void BeginCulling(Box viewport);
+    /* If the render didn't make as many calls as there are boxes, they belong
+     * to some other document and are dropped. */
+    void EndCulling();
+    /* Counts a draw call that a wrapper around this one dropped instead of
+     * passing on, so that the calls after it still line up with their
+     * boxes. */
+    void SkipDraw();
+    size_t CulledDraws() const { return mCulledDraws; }
+
+private:
+    bool Visible(const std::vector<Box>& bounds, size_t index) const;
+    bool Skip();
+
+    std::shared_ptr<SVGRenderer> mRenderer;
+    std::vector<Box> mDrawBounds;
+    std::vector<Box> mGroupBounds;
+    bool mCulling;
+    Box mViewport;
+    size_t mDraw;
+    size_t mGroup;
+    /* Save() depth inside the outermost culled group, 0 outside of one. */
+    int mCulledDepth;
+    size_t mCulledDraws;
+};
+
+} // namespace SVGNative
+
+#endif
@@ -0,0 +1,564 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "GeometrySVGRenderer.h"
+#include "stroke-bounds.h"
+
+namespace SVGNative
+{
+/* Flattening tolerance in device units for clip intersections, and the most
+ * edge pair tests spent on one element or one clip path before settling for
+ * box intersection. */
+static const double kClipTolerance = 0.05;
+static const size_t kClipBudget = 4000000;
+
+/* FNV-1a over the bytes of each value. */
+static const uint64_t kHashSeed = 14695981039346656037ull;
+
+static uint64_t hashValue(uint64_t hash, double value)
+{
+    unsigned char bytes[sizeof(double)];
+    memcpy(bytes, &value, sizeof(double));
+    for (unsigned char byte : bytes)
+        hash = (hash ^ byte) * 1099511628211ull;
+    return hash;
+}
+
+/* A second hash, a multiply and rotate over whole values, that has nothing
+ * in common with FNV-1a; a collision in both at once is not a concern. */
+static uint64_t checkValue(uint64_t check, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(double));
+    check = (check ^ bits) * 0x9e3779b97f4a7c15ull;
+    return (check << 31) | (check >> 33);
+}
+
+GeometrySVGPath::GeometrySVGPath()
+    : mCurrent{0, 0}
+    , mHasSubpath{false}
+    , mHash{kHashSeed}
+    , mCheck{0}
+    , mSegmentCount{0}
+{
+}
+
+void GeometrySVGPath::Mix(double value)
+{
+    mHash = hashValue(mHash, value);
+    mCheck = checkValue(mCheck, value);
+}
+
+Subpath& GeometrySVGPath::CurrentSubpath()
+{
+    if (!mHasSubpath)
+        MoveTo(mCurrent.x, mCurrent.y);
+    return mGeometry.subpaths.back();
+}
+
+void GeometrySVGPath::AddLine(Point to)
+{
+    Subpath& subpath = CurrentSubpath();
+    Segment segment;
+    segment.type = SEGMENT_LINE;
+    segment.p[0] = mCurrent;
+    segment.p[1] = mCurrent;
+    segment.p[2] = to;
+    segment.p[3] = to;
+    subpath.segments.push_back(segment);
+    mSegmentCount++;
+    mCurrent = to;
+    Mix(SEGMENT_LINE);
+    Mix(to.x);
+    Mix(to.y);
+}
+
+void GeometrySVGPath::AddArc(Point center, Point radii, double startAngle, double sweep)
+{
+    Subpath& subpath = CurrentSubpath();
+    Segment segment;
+    segment.type = SEGMENT_ARC;
+    segment.center = center;
+    segment.radii = radii;
+    segment.start_angle = startAngle;
+    segment.sweep = sweep;
+    segment.p[0] = mCurrent;
+    segment.p[3] = segmentPoint(&segment, 1);
+    segment.p[1] = segment.p[0];
+    segment.p[2] = segment.p[3];
+    subpath.segments.push_back(segment);
+    mSegmentCount++;
+    mCurrent = segment.p[3];
+    Mix(SEGMENT_ARC);
+    Mix(center.x);
+    Mix(center.y);
+    Mix(radii.x);
+    Mix(radii.y);
+    Mix(startAngle);
+    Mix(sweep);
+}
+
+void GeometrySVGPath::Rect(float x, float y, float width, float height)
+{
+    MoveTo(x, y);
+    LineTo(x + width, y);
+    LineTo(x + width, y + height);
+    LineTo(x, y + height);
+    ClosePath();
+}
+
+void GeometrySVGPath::RoundedRect(float x, float y, float width, float height, float cornerRadiusX, float cornerRadiusY)
+{
+    double rx = fmin(cornerRadiusX, width / 2.0);
+    double ry = fmin(cornerRadiusY, height / 2.0);
+    if (rx <= 0 || ry <= 0)
+    {
+        Rect(x, y, width, height);
+        return;
+    }
+    Point radii = {rx, ry};
+    MoveTo(x + rx, y);
+    LineTo(x + width - rx, y);
+    AddArc({x + width - rx, y + ry}, radii, -M_PI / 2, M_PI / 2);
+    LineTo(x + width, y + height - ry);
+    AddArc({x + width - rx, y + height - ry}, radii, 0, M_PI / 2);
+    LineTo(x + rx, y + height);
+    AddArc({x + rx, y + height - ry}, radii, M_PI / 2, M_PI / 2);
+    LineTo(x, y + ry);
+    AddArc({x + rx, y + ry}, radii, M_PI, M_PI / 2);
+    ClosePath();
+}
+
+void GeometrySVGPath::Ellipse(float cx, float cy, float rx, float ry)
+{
+    MoveTo(cx + rx, cy);
+    AddArc({cx, cy}, {rx, ry}, 0, 2 * M_PI);
+    ClosePath();
+}
+
+void GeometrySVGPath::MoveTo(float x, float y)
+{
+    Subpath subpath;
+    subpath.start = {x, y};
+    subpath.closed = false;
+    mGeometry.subpaths.push_back(subpath);
+    mCurrent = {x, y};
+    mHasSubpath = true;
+    Mix(-1);
+    Mix(x);
+    Mix(y);
+}
+
+void GeometrySVGPath::LineTo(float x, float y)
+{
+    AddLine({x, y});
+}
+
+void GeometrySVGPath::CurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
+{
+    Subpath& subpath = CurrentSubpath();
+    Segment segment;
+    segment.type = SEGMENT_CUBIC;
+    segment.p[0] = mCurrent;
+    segment.p[1] = {x1, y1};
+    segment.p[2] = {x2, y2};
+    segment.p[3] = {x3, y3};
+    subpath.segments.push_back(segment);
+    mSegmentCount++;
+    mCurrent = segment.p[3];
+    Mix(SEGMENT_CUBIC);
+    for (int i = 1; i < 4; i++)
+    {
+        Mix(segment.p[i].x);
+        Mix(segment.p[i].y);
+    }
+}
+
+void GeometrySVGPath::CurveToV(float x2, float y2, float x3, float y3)
+{
+    CurveTo(mCurrent.x, mCurrent.y, x2, y2, x3, y3);
+}
+
+void GeometrySVGPath::ClosePath()
+{
+    if (!mHasSubpath)
+        return;
+    Subpath& subpath = mGeometry.subpaths.back();
+    if (mCurrent.x != subpath.start.x || mCurrent.y != subpath.start.y)
+        AddLine(subpath.start);
+    subpath.closed = true;
+    mCurrent = subpath.start;
+    mHasSubpath = false;
+    Mix(-2);
+}
+
+GeometrySVGTransform::GeometrySVGTransform(float a, float b, float c, float d, float tx, float ty)
+{
+    Set(a, b, c, d, tx, ty);
+}
+
+void GeometrySVGTransform::Set(float a, float b, float c, float d, float tx, float ty)
+{
+    mMatrix = {a, b, c, d, tx, ty};
+}
+
+void GeometrySVGTransform::Rotate(float r)
+{
+    double radians = r * M_PI / 180.0;
+    Matrix rotation = {cos(radians), sin(radians), -sin(radians), cos(radians), 0, 0};
+    mMatrix = matrixMultiply(mMatrix, rotation);
+}
+
+void GeometrySVGTransform::Translate(float tx, float ty)
+{
+    Matrix translation = {1, 0, 0, 1, tx, ty};
+    mMatrix = matrixMultiply(mMatrix, translation);
+}
+
+void GeometrySVGTransform::Scale(float sx, float sy)
+{
+    Matrix scale = {sx, 0, 0, sy, 0, 0};
+    mMatrix = matrixMultiply(mMatrix, scale);
+}
+
+void GeometrySVGTransform::Concat(const Transform& other)
+{
+    /* Same order as cairo_matrix_multiply(&m, &m, &other) in the Cairo port. */
+    mMatrix = matrixMultiply(static_cast<const GeometrySVGTransform&>(other).mMatrix, mMatrix);
+}
+
+static int base64Value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+' || c == '-')
+        return 62;
+    if (c == '/' || c == '_')
+        return 63;
+    return -1;
+}
+
+/* Decodes base64 into `out` until it holds `wanted` bytes or the input ends. */
+static void decodeBase64Prefix(const std::string& base64, size_t wanted, std::vector<unsigned char>& out)
+{
+    unsigned int bits = 0;
+    int count = 0;
+    for (char c : base64)
+    {
+        int value = base64Value(c);
+        if (value < 0)
+            continue;
+        bits = (bits << 6) | value;
+        count += 6;
+        if (count >= 8)
+        {
+            count -= 8;
+            out.push_back((bits >> count) & 0xff);
+            if (out.size() >= wanted)
+                return;
+        }
+    }
+}
+
+static unsigned int readBigEndian(const std::vector<unsigned char>& bytes, size_t offset, int size)
+{
+    unsigned int value = 0;
+    for (int i = 0; i < size; i++)
+        value = (value << 8) | bytes[offset + i];
+    return value;
+}
+
+/* Image dimensions come from the PNG IHDR chunk or the JPEG SOF marker, so
+ * only the header bytes are ever decoded. */
+GeometrySVGImageData::GeometrySVGImageData(const std::string& base64, ImageEncoding encoding)
+    : mWidth{0}
+    , mHeight{0}
+{
+    std::vector<unsigned char> bytes;
+    if (encoding == ImageEncoding::kPNG)
+    {
+        decodeBase64Prefix(base64, 24, bytes);
+        if (bytes.size() >= 24)
+        {
+            mWidth = readBigEndian(bytes, 16, 4);
+            mHeight = readBigEndian(bytes, 20, 4);
+        }
+        return;
+    }
+
+    size_t wanted = 4096;
+    while (true)
+    {
+        bytes.clear();
+        decodeBase64Prefix(base64, wanted, bytes);
+        size_t offset = 2;
+        while (offset + 9 <= bytes.size())
+        {
+            if (bytes[offset] != 0xff)
+                return;
+            unsigned char marker = bytes[offset + 1];
+            bool sof = marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+            if (sof)
+            {
+                mHeight = readBigEndian(bytes, offset + 5, 2);
+                mWidth = readBigEndian(bytes, offset + 7, 2);
+                return;
+            }
+            offset += 2 + readBigEndian(bytes, offset + 2, 2);
+        }
+        if (bytes.size() < wanted)
+            return;
+        wanted = offset + 4096;
+    }
+}
+
+GeometrySVGRenderer::GeometrySVGRenderer()
+{
+    Reset(identityMatrix());
+}
+
+void GeometrySVGRenderer::Reset(Matrix base)
+{
+    double inf = std::numeric_limits<double>::infinity();
+    GeometryState state;
+    state.ctm = base;
+    state.clip = {-inf, -inf, inf, inf};
+    state.group = -1;
+    mStack.clear();
+    mStack.push_back(state);
+    mElementBounds.clear();
+    mElementParents.clear();
+    mGroupParents.clear();
+    mDrawBounds.clear();
+    mDrawScales.clear();
+    mGroupBounds.clear();
+    mDocumentBounds = emptyBox();
+    mInstanceBounds.clear();
+}
+
+std::unique_ptr<ImageData> GeometrySVGRenderer::CreateImageData(const std::string& base64, ImageEncoding encoding)
+{
+    return std::unique_ptr<GeometrySVGImageData>(new GeometrySVGImageData(base64, encoding));
+}
+
+std::unique_ptr<Path> GeometrySVGRenderer::CreatePath()
+{
+    return std::unique_ptr<GeometrySVGPath>(new GeometrySVGPath);
+}
+
+std::unique_ptr<Transform> GeometrySVGRenderer::CreateTransform(float a, float b, float c, float d, float tx, float ty)
+{
+    return std::unique_ptr<GeometrySVGTransform>(new GeometrySVGTransform(a, b, c, d, tx, ty));
+}
+
+void GeometrySVGRenderer::PushState(const GraphicStyle& graphicStyle)
+{
+    GeometryState state = mStack.back();
+    if (graphicStyle.transform)
+        state.ctm = matrixMultiply(state.ctm, static_cast<const GeometrySVGTransform*>(graphicStyle.transform.get())->GetMatrix());
+    if (graphicStyle.clippingPath)
+    {
+        const ClippingPath& clip = *graphicStyle.clippingPath;
+        if (!clip.hasClipContent || !clip.path)
+            state.clip = emptyBox();
+        else
+        {
+            Matrix clipMatrix = state.ctm;
+            if (clip.transform)
+                clipMatrix = matrixMultiply(clipMatrix, static_cast<const GeometrySVGTransform*>(clip.transform.get())->GetMatrix());
+            const PathGeometry& clipGeometry = static_cast<const GeometrySVGPath*>(clip.path.get())->Geometry();
+            state.clip = boxIntersect(state.clip, transformedFillBounds(&clipGeometry, clipMatrix));
+
+            /* Past the budget the outlines so far are dropped and state.clip,
+             * which still has all their boxes, is all that clips; clip paths
+             * nested further in start a new region. */
+            Polygon outline;
+            flattenPath(&clipGeometry, clipMatrix, kClipTolerance, clip.clipRule == WindingRule::kEvenOdd, &outline);
+            auto region = std::make_shared<ClipRegion>();
+            if (state.clipRegion)
+                *region = *state.clipRegion;
+            else
+                initializeClipRegion(region.get());
+            if (addClipShape(region.get(), outline, kClipBudget))
+                state.clipRegion = region;
+            else
+                state.clipRegion = nullptr;
+        }
+    }
+    mStack.push_back(state);
+}
+
+/* Save() is only called by the document, once per group, while draw calls
+ * push their own style with PushState(). */
+void GeometrySVGRenderer::Save(const GraphicStyle& graphicStyle)
+{
+    int parent = mStack.back().group;
+    PushState(graphicStyle);
+    mStack.back().group = static_cast<int>(mGroupParents.size());
+    mGroupParents.push_back(parent);
+    mGroupBounds.push_back(emptyBox());
+}
+
+/* Closing a group adds its box to the enclosing one. */
+void GeometrySVGRenderer::Restore()
+{
+    if (mStack.size() <= 1)
+        return;
+    int group = mStack.back().group;
+    mStack.pop_back();
+    int parent = mStack.back().group;
+    if (group != parent && group >= 0 && parent >= 0)
+        mGroupBounds[parent] = boxUnion(mGroupBounds[parent], mGroupBounds[group]);
+}
+
+/* `box` is the element's exact unclipped bounds, which the result never
+ * exceeds: the flattened outlines are only used to trim it. */
+Box GeometrySVGRenderer::ClippedBounds(std::vector<Polygon> const& subjects, Box box) const
+{
+    const GeometryState& state = mStack.back();
+    Box clipped = emptyBox();
+    for (auto const& subject : subjects)
+    {
+        Box piece;
+        if (!clippedBounds(&subject, state.clipRegion.get(), kClipBudget, &piece))
+            return box;
+        clipped = boxUnion(clipped, piece);
+    }
+    return boxIntersect(box, clipped);
+}
+
+void GeometrySVGRenderer::AddElementBounds(Box box)
+{
+    box = boxIntersect(box, mStack.back().clip);
+    mDrawBounds.push_back(box);
+    mDrawScales.push_back(matrixScale(mStack.back().ctm));
+    if (boxIsEmpty(box))
+        return;
+    int group = mStack.back().group;
+    if (group >= 0)
+        mGroupBounds[group] = boxUnion(mGroupBounds[group], box);
+    mElementBounds.push_back(box);
+    mElementParents.push_back(mStack.back().group);
+    mDocumentBounds = boxUnion(mDocumentBounds, box);
+}
+
+static StrokeParams strokeParams(const StrokeStyle& strokeStyle)
+{
+    StrokeParams stroke;
+    stroke.width = strokeStyle.lineWidth;
+    stroke.cap = strokeStyle.lineCap == LineCap::kRound ? CAP_ROUND : strokeStyle.lineCap == LineCap::kSquare ? CAP_SQUARE : CAP_BUTT;
+    stroke.join = strokeStyle.lineJoin == LineJoin::kRound ? JOIN_ROUND : strokeStyle.lineJoin == LineJoin::kBevel ? JOIN_BEVEL : JOIN_MITER;
+    stroke.miter_limit = strokeStyle.miterLimit;
+    stroke.dashes.assign(strokeStyle.dashArray.begin(), strokeStyle.dashArray.end());
+    stroke.dash_offset = strokeStyle.dashOffset;
+    return stroke;
+}
+
+size_t GeometrySVGRenderer::InstanceKeyHash::operator()(const InstanceKey& key) const
+{
+    uint64_t hash = hashValue(key.path, key.a);
+    hash = hashValue(hash, key.b);
+    hash = hashValue(hash, key.c);
+    hash = hashValue(hash, key.d);
+    return hash ^ key.style;
+}
+
+/* Bounds are computed under the linear part of `ctm` only and then moved by
+ * its translation, which is exact for both fill and stroke. */
+Box GeometrySVGRenderer::InstanceBounds(const GeometrySVGPath& path, Matrix ctm, const FillStyle& fillStyle, const StrokeStyle& strokeStyle)
+{
+    bool stroked = strokeStyle.hasStroke && strokeStyle.lineWidth > 0;
+    uint64_t style = hashValue(kHashSeed, fillStyle.hasFill);
+    style = hashValue(style, stroked);
+    if (stroked)
+    {
+        style = hashValue(style, strokeStyle.lineWidth);
+        style = hashValue(style, static_cast<int>(strokeStyle.lineCap));
+        style = hashValue(style, static_cast<int>(strokeStyle.lineJoin));
+        style = hashValue(style, strokeStyle.miterLimit);
+        style = hashValue(style, strokeStyle.dashOffset);
+        for (auto dash : strokeStyle.dashArray)
+            style = hashValue(style, dash);
+    }
+
+    InstanceKey key = {path.Hash(), path.CheckHash(), path.SegmentCount(), ctm.a, ctm.b, ctm.c, ctm.d, style};
+    auto cached = mInstanceBounds.find(key);
+    Box box;
+    if (cached != mInstanceBounds.end())
+        box = cached->second;
+    else
+    {
+        const PathGeometry& geometry = path.Geometry();
+        Matrix linear = {ctm.a, ctm.b, ctm.c, ctm.d, 0, 0};
+        box = emptyBox();
+        if (fillStyle.hasFill)
+            box = transformedFillBounds(&geometry, linear);
+        if (stroked)
+        {
+            StrokeParams stroke = strokeParams(strokeStyle);
+            box = boxUnion(box, transformedStrokeBounds(&geometry, &stroke, linear));
+        }
+        mInstanceBounds.emplace(key, box);
+    }
+    if (boxIsEmpty(box))
+        return box;
+    return {box.x0 + ctm.tx, box.y0 + ctm.ty, box.x1 + ctm.tx, box.y1 + ctm.ty};
+}
+
+void GeometrySVGRenderer::DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle)
+{
+    PushState(graphicStyle);
+    const GeometrySVGPath& geometryPath = static_cast<const GeometrySVGPath&>(path);
+    const PathGeometry& geometry = geometryPath.Geometry();
+    Matrix ctm = mStack.back().ctm;
+    Box box = InstanceBounds(geometryPath, ctm, fillStyle, strokeStyle);
+
+    const GeometryState& state = mStack.back();
+    if (state.clipRegion && !boxIsEmpty(boxIntersect(box, state.clip)))
+    {
+        std::vector<Polygon> subjects;
+        if (fillStyle.hasFill)
+        {
+            subjects.push_back(Polygon());
+            flattenPath(&geometry, ctm, kClipTolerance, fillStyle.fillRule == WindingRule::kEvenOdd, &subjects.back());
+        }
+        if (strokeStyle.hasStroke && strokeStyle.lineWidth > 0)
+        {
+            StrokeParams stroke = strokeParams(strokeStyle);
+            strokePieces(&geometry, &stroke, ctm, kClipTolerance, &subjects);
+        }
+        box = ClippedBounds(subjects, box);
+    }
+    AddElementBounds(box);
+    Restore();
+}
+
+void GeometrySVGRenderer::DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea)
+{
+    PushState(graphicStyle);
+    Box fill = {fillArea.x, fillArea.y, fillArea.x + fillArea.width, fillArea.y + fillArea.height};
+    Box clip = {clipArea.x, clipArea.y, clipArea.x + clipArea.width, clipArea.y + clipArea.height};
+    Box area = boxIntersect(fill, clip);
+    Matrix ctm = mStack.back().ctm;
+    Box box = transformBox(ctm, area);
+    if (mStack.back().clipRegion && !boxIsEmpty(area))
+    {
+        std::vector<Polygon> subjects(1);
+        subjects[0].even_odd = false;
+        std::vector<Point> corners = {{area.x0, area.y0}, {area.x1, area.y0}, {area.x1, area.y1}, {area.x0, area.y1}};
+        for (auto& p : corners)
+            p = transformPoint(ctm, p);
+        subjects[0].contours.push_back(corners);
+        subjects[0].box = box;
+        box = ClippedBounds(subjects, box);
+    }
+    AddElementBounds(box);
+    Restore();
+}
+
+} // namespace SVGNative
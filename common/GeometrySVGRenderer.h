@@ -0,0 +1,174 @@
+#ifndef GEOMETRY_SVG_RENDERER_H
+#define GEOMETRY_SVG_RENDERER_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <svgnative/SVGRenderer.h>
+
+#include "geometry.h"
+#include "clip-bounds.h"
+
+/* An SVGNative port that never rasterizes. Paths are recorded as exact
+ * segments (lines, cubics and elliptic arcs) and every draw call adds the
+ * bounds of its geometry under the current transform stack, intersected with
+ * the current clip. Clipped elements are intersected with the actual clip
+ * outlines, not just their boxes, unless that exceeds the clip budget.
+ *
+ * Paths hash their segments as they are built, so every <use> instance of the
+ * same shape carries the same hash whether or not the document hands over the
+ * same Path object. The unclipped bounds are cached per shape, linear part of
+ * the transform and stroke style, and instances that only differ by a
+ * translation (the x/y of <use>) reuse the cached box. */
+
+namespace SVGNative
+{
+class GeometrySVGPath final : public Path
+{
+public:
+    GeometrySVGPath();
+
+    void Rect(float x, float y, float width, float height) override;
+    void RoundedRect(float x, float y, float width, float height, float cornerRadiusX, float cornerRadiusY) override;
+    void Ellipse(float cx, float cy, float rx, float ry) override;
+
+    void MoveTo(float x, float y) override;
+    void LineTo(float x, float y) override;
+    void CurveTo(float x1, float y1, float x2, float y2, float x3, float y3) override;
+    void CurveToV(float x2, float y2, float x3, float y3) override;
+    void ClosePath() override;
+
+    const PathGeometry& Geometry() const { return mGeometry; }
+    uint64_t Hash() const { return mHash; }
+    /* An independent hash and the number of segments, which the bounds cache
+     * compares as well so that a collision of Hash() alone can't mix up two
+     * shapes. */
+    uint64_t CheckHash() const { return mCheck; }
+    size_t SegmentCount() const { return mSegmentCount; }
+
+private:
+    Subpath& CurrentSubpath();
+    void Mix(double value);
+    void AddLine(Point to);
+    void AddArc(Point center, Point radii, double startAngle, double sweep);
+
+    PathGeometry mGeometry;
+    Point mCurrent;
+    bool mHasSubpath;
+    uint64_t mHash;
+    uint64_t mCheck;
+    size_t mSegmentCount;
+};
+
+class GeometrySVGTransform final : public Transform
+{
+public:
+    GeometrySVGTransform(float a, float b, float c, float d, float tx, float ty);
+
+    void Set(float a, float b, float c, float d, float tx, float ty) override;
+    void Rotate(float r) override;
+    void Translate(float tx, float ty) override;
+    void Scale(float sx, float sy) override;
+    void Concat(const Transform& other) override;
+
+    Matrix GetMatrix() const { return mMatrix; }
+
+private:
+    Matrix mMatrix;
+};
+
+class GeometrySVGImageData final : public ImageData
+{
+public:
+    GeometrySVGImageData(const std::string& base64, ImageEncoding encoding);
+
+    float Width() const override { return mWidth; }
+    float Height() const override { return mHeight; }
+
+private:
+    float mWidth;
+    float mHeight;
+};
+
+class GeometrySVGRenderer final : public SVGRenderer
+{
+public:
+    GeometrySVGRenderer();
+
+    std::unique_ptr<ImageData> CreateImageData(const std::string& base64, ImageEncoding encoding) override;
+    std::unique_ptr<Path> CreatePath() override;
+    std::unique_ptr<Transform> CreateTransform(float a = 1.0, float b = 0.0, float c = 0.0, float d = 1.0, float tx = 0.0, float ty = 0.0) override;
+
+    void Save(const GraphicStyle& graphicStyle) override;
+    void Restore() override;
+
+    void DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle) override;
+    void DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea) override;
+
+    /* Forgets the boxes and cached instances of the previous document and
+     * resets the transform stack to `base`. */
+    void Reset(Matrix base);
+    const std::vector<Box>& ElementBounds() const { return mElementBounds; }
+    /* The group each element was drawn in and the group each group is
+     * nested in, -1 at the top level. Groups are numbered in the order they
+     * were opened. */
+    const std::vector<int>& ElementParents() const { return mElementParents; }
+    const std::vector<int>& GroupParents() const { return mGroupParents; }
+    /* One box per draw call, empty for those that draw nothing, and one per
+     * group covering everything drawn inside it, both in call order. This is
+     * what CullingSVGRenderer and LodSVGRenderer line their calls up with.
+     * DrawScales() is the most the transform of each draw call stretches its
+     * path. */
+    const std::vector<Box>& DrawBounds() const { return mDrawBounds; }
+    const std::vector<double>& DrawScales() const { return mDrawScales; }
+    const std::vector<Box>& GroupBounds() const { return mGroupBounds; }
+    Box DocumentBounds() const { return mDocumentBounds; }
+
+private:
+    struct GeometryState
+    {
+        Matrix ctm;
+        Box clip;
+        std::shared_ptr<const ClipRegion> clipRegion;
+        int group;
+    };
+
+    struct InstanceKey
+    {
+        uint64_t path;
+        uint64_t pathCheck;
+        size_t segmentCount;
+        double a, b, c, d;
+        uint64_t style;
+
+        bool operator==(const InstanceKey& other) const
+        {
+            return path == other.path && pathCheck == other.pathCheck && segmentCount == other.segmentCount && a == other.a && b == other.b && c == other.c && d == other.d && style == other.style;
+        }
+    };
+
+    struct InstanceKeyHash
+    {
+        size_t operator()(const InstanceKey& key) const;
+    };
+
+    void PushState(const GraphicStyle& graphicStyle);
+    void AddElementBounds(Box box);
+    Box ClippedBounds(std::vector<Polygon> const& subjects, Box box) const;
+    Box InstanceBounds(const GeometrySVGPath& path, Matrix ctm, const FillStyle& fillStyle, const StrokeStyle& strokeStyle);
+
+    std::vector<GeometryState> mStack;
+    std::vector<Box> mElementBounds;
+    std::vector<int> mElementParents;
+    std::vector<int> mGroupParents;
+    std::vector<Box> mDrawBounds;
+    std::vector<double> mDrawScales;
+    std::vector<Box> mGroupBounds;
+    Box mDocumentBounds;
+    std::unordered_map<InstanceKey, Box, InstanceKeyHash> mInstanceBounds;
+};
+
+} // namespace SVGNative
+
+#endif
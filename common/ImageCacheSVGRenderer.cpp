@@ -0,0 +1,167 @@
+#include <algorithm>
+
+#include "ImageCacheSVGRenderer.h"
+#include "GeometrySVGRenderer.h"
+
+namespace SVGNative
+{
+static const size_t kSharedImageBudget = 256 * 1024 * 1024;
+
+ImageCache::ImageCache(size_t budget)
+    : mBudget{budget}
+    , mBytes{0}
+{
+}
+
+std::shared_ptr<ImageData> ImageCache::Find(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto found = mIndex.find(key);
+    if (found == mIndex.end())
+        return nullptr;
+    mEntries.splice(mEntries.begin(), mEntries, found->second);
+    return found->second->image;
+}
+
+/* Two threads may decode the same image at once; the first one in wins. The
+ * newest entry is never evicted, even when it alone exceeds the budget. */
+void ImageCache::Insert(const Key& key, std::shared_ptr<ImageData> image)
+{
+    size_t bytes = static_cast<size_t>(image->Width()) * static_cast<size_t>(image->Height()) * 4;
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mIndex.count(key))
+        return;
+    mEntries.push_front({key, std::move(image), bytes});
+    mIndex[key] = mEntries.begin();
+    mBytes += bytes;
+    while (mBytes > mBudget && mEntries.size() > 1)
+    {
+        mBytes -= mEntries.back().bytes;
+        mIndex.erase(mEntries.back().key);
+        mEntries.pop_back();
+    }
+}
+
+std::shared_ptr<ImageCache> sharedImageCache()
+{
+    static std::shared_ptr<ImageCache> cache = std::make_shared<ImageCache>(kSharedImageBudget);
+    return cache;
+}
+
+/* FNV-1a over the base64 text. Together with its length and encoding that is
+ * the cache key, so identical images embedded anywhere share one entry. */
+CachedSVGImageData::CachedSVGImageData(const std::string& base64, ImageEncoding encoding)
+    : mBase64{base64}
+    , mEncoding{encoding}
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : base64)
+        hash = (hash ^ c) * 1099511628211ull;
+    mKey = {hash, base64.size(), encoding, &typeid(void)};
+
+    GeometrySVGImageData header(base64, encoding);
+    mWidth = header.Width();
+    mHeight = header.Height();
+}
+
+ImageCacheSVGRenderer::ImageCacheSVGRenderer(std::shared_ptr<SVGRenderer> renderer, std::shared_ptr<ImageCache> cache)
+    : mRenderer{renderer}
+    , mCache{cache}
+    , mPort{&typeid(*renderer)}
+    , mBoundsOnly{false}
+{
+}
+
+/* The size is all the document needs to lay an image out. Only when the
+ * header couldn't be read is the image decoded up front to get it. */
+std::unique_ptr<ImageData> ImageCacheSVGRenderer::CreateImageData(const std::string& base64, ImageEncoding encoding)
+{
+    auto image = std::unique_ptr<CachedSVGImageData>(new CachedSVGImageData(base64, encoding));
+    if (image->Width() <= 0 || image->Height() <= 0)
+    {
+        std::shared_ptr<ImageData> decoded = Decode(*image);
+        if (decoded)
+            image->SetSize(decoded->Width(), decoded->Height());
+    }
+    return image;
+}
+
+std::unique_ptr<Path> ImageCacheSVGRenderer::CreatePath()
+{
+    return mRenderer->CreatePath();
+}
+
+std::unique_ptr<Transform> ImageCacheSVGRenderer::CreateTransform(float a, float b, float c, float d, float tx, float ty)
+{
+    return mRenderer->CreateTransform(a, b, c, d, tx, ty);
+}
+
+void ImageCacheSVGRenderer::Save(const GraphicStyle& graphicStyle)
+{
+    mRenderer->Save(graphicStyle);
+}
+
+void ImageCacheSVGRenderer::Restore()
+{
+    mRenderer->Restore();
+}
+
+void ImageCacheSVGRenderer::DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle)
+{
+    mRenderer->DrawPath(path, graphicStyle, fillStyle, strokeStyle);
+}
+
+std::shared_ptr<ImageData> ImageCacheSVGRenderer::Decode(const CachedSVGImageData& image)
+{
+    ImageCache::Key key = image.Key();
+    key.port = mPort;
+    std::shared_ptr<ImageData> decoded = mCache->Find(key);
+    if (decoded)
+        return decoded;
+    decoded = mRenderer->CreateImageData(image.Base64(), image.Encoding());
+    if (decoded)
+        mCache->Insert(key, decoded);
+    return decoded;
+}
+
+void ImageCacheSVGRenderer::DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea)
+{
+    const CachedSVGImageData& cached = static_cast<const CachedSVGImageData&>(image);
+    float x0 = std::max(clipArea.x, fillArea.x);
+    float y0 = std::max(clipArea.y, fillArea.y);
+    float x1 = std::min(clipArea.x + clipArea.width, fillArea.x + fillArea.width);
+    float y1 = std::min(clipArea.y + clipArea.height, fillArea.y + fillArea.height);
+    if (x1 <= x0 || y1 <= y0)
+        return;
+    Rect area(x0, y0, x1 - x0, y1 - y0);
+
+    if (mBoundsOnly)
+    {
+        std::unique_ptr<Path> path = mRenderer->CreatePath();
+        path->Rect(area.x, area.y, area.width, area.height);
+        FillStyle fillStyle;
+        fillStyle.hasFill = true;
+        fillStyle.fillRule = WindingRule::kNonZero;
+        fillStyle.fillOpacity = 1.0;
+        fillStyle.paint = Color{{0, 0, 0, 1}};
+        StrokeStyle strokeStyle;
+        strokeStyle.hasStroke = false;
+        mRenderer->DrawPath(*path, graphicStyle, fillStyle, strokeStyle);
+        return;
+    }
+
+    if (mVisible)
+    {
+        mRenderer->Save(graphicStyle);
+        bool visible = mVisible(area);
+        mRenderer->Restore();
+        if (!visible)
+            return;
+    }
+
+    std::shared_ptr<ImageData> decoded = Decode(cached);
+    if (decoded)
+        mRenderer->DrawImage(*decoded, graphicStyle, clipArea, fillArea);
+}
+
+} // namespace SVGNative
@@ -0,0 +1,135 @@
+#ifndef IMAGE_CACHE_SVG_RENDERER_H
+#define IMAGE_CACHE_SVG_RENDERER_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <typeinfo>
+#include <unordered_map>
+
+#include <svgnative/SVGRenderer.h>
+
+/* Wraps another SVGNative port so that data: URI images are decoded lazily
+ * and at most once per process. Parsing only reads the image size from the
+ * PNG or JPEG header. The pixels are decoded by the wrapped port the first
+ * time the image is drawn inside the visible area, and the result is kept in
+ * an ImageCache keyed by the content of the base64 data, so that reloading a
+ * document or loading another one with the same image doesn't decode it
+ * again. Decoded images only work with the port type that made them, so the
+ * key also holds the wrapped port's type and the Cairo and Skia wrappers
+ * never see each other's entries. Paths and transforms are the wrapped
+ * port's own. */
+
+namespace SVGNative
+{
+/* Decoded images shared across frames, documents and threads, evicted least
+ * recently used first once they take more than `budget` bytes. Images still
+ * in use by a draw call stay alive until it is done. */
+class ImageCache final
+{
+public:
+    explicit ImageCache(size_t budget);
+
+    struct Key
+    {
+        uint64_t hash;
+        size_t length;
+        ImageEncoding encoding;
+        const std::type_info* port;
+
+        bool operator==(const Key& other) const
+        {
+            return hash == other.hash && length == other.length && encoding == other.encoding && *port == *other.port;
+        }
+    };
+
+    std::shared_ptr<ImageData> Find(const Key& key);
+    void Insert(const Key& key, std::shared_ptr<ImageData> image);
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const { return key.hash ^ key.length ^ key.port->hash_code(); }
+    };
+
+    struct Entry
+    {
+        Key key;
+        std::shared_ptr<ImageData> image;
+        size_t bytes;
+    };
+
+    std::mutex mMutex;
+    size_t mBudget;
+    size_t mBytes;
+    std::list<Entry> mEntries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> mIndex;
+};
+
+/* The process wide cache, 256MB of decoded pixels. */
+std::shared_ptr<ImageCache> sharedImageCache();
+
+class CachedSVGImageData final : public ImageData
+{
+public:
+    CachedSVGImageData(const std::string& base64, ImageEncoding encoding);
+
+    float Width() const override { return mWidth; }
+    float Height() const override { return mHeight; }
+
+    const std::string& Base64() const { return mBase64; }
+    ImageEncoding Encoding() const { return mEncoding; }
+    /* The key without a port; the wrapper fills that in. */
+    ImageCache::Key Key() const { return mKey; }
+    void SetSize(float width, float height)
+    {
+        mWidth = width;
+        mHeight = height;
+    }
+
+private:
+    std::string mBase64;
+    ImageEncoding mEncoding;
+    ImageCache::Key mKey;
+    float mWidth;
+    float mHeight;
+};
+
+class ImageCacheSVGRenderer final : public SVGRenderer
+{
+public:
+    ImageCacheSVGRenderer(std::shared_ptr<SVGRenderer> renderer, std::shared_ptr<ImageCache> cache);
+
+    std::unique_ptr<ImageData> CreateImageData(const std::string& base64, ImageEncoding encoding) override;
+    std::unique_ptr<Path> CreatePath() override;
+    std::unique_ptr<Transform> CreateTransform(float a = 1.0, float b = 0.0, float c = 0.0, float d = 1.0, float tx = 0.0, float ty = 0.0) override;
+
+    void Save(const GraphicStyle& graphicStyle) override;
+    void Restore() override;
+
+    void DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle) override;
+    void DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea) override;
+
+    /* Called with the image area in user space, after the image's own
+     * transform and clip have been applied to the wrapped port. Images it
+     * returns false for are skipped without being decoded. Unset, every image
+     * is drawn, which is what recording a display list needs. */
+    void SetVisibleTest(std::function<bool(const Rect&)> visible) { mVisible = std::move(visible); }
+    /* For bounding box queries: images are drawn as a filled rectangle over
+     * the area they would cover, so their pixels are never decoded. */
+    void SetBoundsOnly(bool boundsOnly) { mBoundsOnly = boundsOnly; }
+
+private:
+    std::shared_ptr<ImageData> Decode(const CachedSVGImageData& image);
+
+    std::shared_ptr<SVGRenderer> mRenderer;
+    std::shared_ptr<ImageCache> mCache;
+    const std::type_info* mPort;
+    std::function<bool(const Rect&)> mVisible;
+    bool mBoundsOnly;
+};
+
+} // namespace SVGNative
+
+#endif
@@ -0,0 +1,307 @@
+#include <cmath>
+
+#include "LodSVGRenderer.h"
+#include "simplify.h"
+
+namespace SVGNative
+{
+/* Device pixels: elements below the first are drawn as a dot of that size,
+ * below the second they are skipped. */
+static const double kDotSize = 1.0;
+static const double kSkipSize = 0.25;
+
+LodSVGPath::LodSVGPath(std::unique_ptr<Path> path, bool recordGeometry)
+    : mPath{std::move(path)}
+    , mRecordGeometry{recordGeometry}
+    , mMeasured{false}
+    , mBuilt{}
+{
+}
+
+void LodSVGPath::Rect(float x, float y, float width, float height)
+{
+    mPath->Rect(x, y, width, height);
+    if (mRecordGeometry)
+        mGeometry.Rect(x, y, width, height);
+}
+
+void LodSVGPath::RoundedRect(float x, float y, float width, float height, float cornerRadiusX, float cornerRadiusY)
+{
+    mPath->RoundedRect(x, y, width, height, cornerRadiusX, cornerRadiusY);
+    if (mRecordGeometry)
+        mGeometry.RoundedRect(x, y, width, height, cornerRadiusX, cornerRadiusY);
+}
+
+void LodSVGPath::Ellipse(float cx, float cy, float rx, float ry)
+{
+    mPath->Ellipse(cx, cy, rx, ry);
+    if (mRecordGeometry)
+        mGeometry.Ellipse(cx, cy, rx, ry);
+}
+
+void LodSVGPath::MoveTo(float x, float y)
+{
+    mPath->MoveTo(x, y);
+    if (mRecordGeometry)
+        mGeometry.MoveTo(x, y);
+}
+
+void LodSVGPath::LineTo(float x, float y)
+{
+    mPath->LineTo(x, y);
+    if (mRecordGeometry)
+        mGeometry.LineTo(x, y);
+}
+
+void LodSVGPath::CurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
+{
+    mPath->CurveTo(x1, y1, x2, y2, x3, y3);
+    if (mRecordGeometry)
+        mGeometry.CurveTo(x1, y1, x2, y2, x3, y3);
+}
+
+void LodSVGPath::CurveToV(float x2, float y2, float x3, float y3)
+{
+    mPath->CurveToV(x2, y2, x3, y3);
+    if (mRecordGeometry)
+        mGeometry.CurveToV(x2, y2, x3, y3);
+}
+
+void LodSVGPath::ClosePath()
+{
+    mPath->ClosePath();
+    if (mRecordGeometry)
+        mGeometry.ClosePath();
+}
+
+Box LodSVGPath::LocalBounds() const
+{
+    if (!mMeasured)
+    {
+        mLocalBounds = transformedFillBounds(&mGeometry.Geometry(), identityMatrix());
+        mMeasured = true;
+    }
+    return mLocalBounds;
+}
+
+static size_t segmentCount(const PathGeometry& geometry)
+{
+    size_t count = 0;
+    for (auto const& subpath : geometry.subpaths)
+        count += subpath.segments.size();
+    return count;
+}
+
+/* Level k keeps within size / 4^(k + 1) of the path, where size is the
+ * diagonal of its bounds, so level 0 is the coarsest. */
+const Path& LodSVGPath::Simplified(double tolerance, SVGRenderer& renderer) const
+{
+    Box box = LocalBounds();
+    if (boxIsEmpty(box))
+        return *mPath;
+    double size = hypot(box.x1 - box.x0, box.y1 - box.y0);
+    int level = 0;
+    double levelTolerance = size / 4;
+    while (level < LOD_LEVELS && levelTolerance > tolerance)
+    {
+        level++;
+        levelTolerance /= 4;
+    }
+    if (level == LOD_LEVELS)
+        return *mPath;
+
+    if (!mBuilt[level])
+    {
+        mBuilt[level] = true;
+        PathGeometry simplified;
+        simplifyPath(&mGeometry.Geometry(), levelTolerance, &simplified);
+        if (segmentCount(simplified) < segmentCount(mGeometry.Geometry()))
+        {
+            mLevels[level] = renderer.CreatePath();
+            for (auto const& subpath : simplified.subpaths)
+            {
+                mLevels[level]->MoveTo(subpath.start.x, subpath.start.y);
+                for (auto const& segment : subpath.segments)
+                    mLevels[level]->LineTo(segment.p[3].x, segment.p[3].y);
+                if (subpath.closed)
+                    mLevels[level]->ClosePath();
+            }
+        }
+    }
+    return mLevels[level] ? *mLevels[level] : *mPath;
+}
+
+LodSVGRenderer::LodSVGRenderer(std::shared_ptr<SVGRenderer> renderer, bool enabled)
+    : mRenderer{renderer}
+    , mEnabled{enabled}
+    , mActive{false}
+    , mViewScale{1}
+    , mDraw{0}
+{
+}
+
+void LodSVGRenderer::SetCulling(std::shared_ptr<CullingSVGRenderer> culling)
+{
+    mCulling = culling;
+}
+
+void LodSVGRenderer::SetDraws(const std::vector<Box>& drawBounds, const std::vector<double>& drawScales)
+{
+    mDrawBounds = drawBounds;
+    mDrawScales = drawScales;
+}
+
+void LodSVGRenderer::BeginLod(double viewScale)
+{
+    mActive = mEnabled;
+    mViewScale = viewScale;
+    mDraw = 0;
+}
+
+/* Boxes from another document are dropped, as in CullingSVGRenderer. */
+void LodSVGRenderer::EndLod()
+{
+    if (mDraw != mDrawBounds.size())
+    {
+        mDrawBounds.clear();
+        mDrawScales.clear();
+    }
+    mActive = false;
+}
+
+std::unique_ptr<ImageData> LodSVGRenderer::CreateImageData(const std::string& base64, ImageEncoding encoding)
+{
+    return mRenderer->CreateImageData(base64, encoding);
+}
+
+std::unique_ptr<Path> LodSVGRenderer::CreatePath()
+{
+    return std::unique_ptr<LodSVGPath>(new LodSVGPath(mRenderer->CreatePath(), mEnabled));
+}
+
+std::unique_ptr<Transform> LodSVGRenderer::CreateTransform(float a, float b, float c, float d, float tx, float ty)
+{
+    return mRenderer->CreateTransform(a, b, c, d, tx, ty);
+}
+
+/* The wrapped port only knows its own paths, so clip paths are swapped for
+ * the ones they wrap. */
+const GraphicStyle& LodSVGRenderer::Unwrap(const GraphicStyle& graphicStyle, GraphicStyle& scratch) const
+{
+    if (!graphicStyle.clippingPath || !graphicStyle.clippingPath->path)
+        return graphicStyle;
+    const ClippingPath& clip = *graphicStyle.clippingPath;
+    scratch = graphicStyle;
+    scratch.clippingPath = std::make_shared<ClippingPath>(clip.hasClipContent, clip.clipRule,
+                                                          static_cast<const LodSVGPath*>(clip.path.get())->Wrapped(), clip.transform);
+    return scratch;
+}
+
+void LodSVGRenderer::Save(const GraphicStyle& graphicStyle)
+{
+    GraphicStyle scratch;
+    mRenderer->Save(Unwrap(graphicStyle, scratch));
+}
+
+void LodSVGRenderer::Restore()
+{
+    mRenderer->Restore();
+}
+
+/* A square one device pixel wide at the center of the path, in its fill,
+ * or in its stroke paint if it has no fill. */
+void LodSVGRenderer::DrawDot(const LodSVGPath& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle, double scale)
+{
+    Box box = path.LocalBounds();
+    if (boxIsEmpty(box))
+        return;
+    double side = kDotSize / scale;
+    std::unique_ptr<Path> dot = mRenderer->CreatePath();
+    dot->Rect((box.x0 + box.x1 - side) / 2, (box.y0 + box.y1 - side) / 2, side, side);
+    FillStyle fill = fillStyle;
+    if (!fill.hasFill)
+    {
+        fill.hasFill = true;
+        fill.fillOpacity = strokeStyle.strokeOpacity;
+        fill.paint = strokeStyle.paint;
+    }
+    fill.fillRule = WindingRule::kNonZero;
+    StrokeStyle stroke = strokeStyle;
+    stroke.hasStroke = false;
+    mRenderer->DrawPath(*dot, graphicStyle, fill, stroke);
+}
+
+/* How far apart, in local units, the stroke's joins and round ones can be:
+ * a miter reaches up to miterLimit - 1 half widths past a round join, and a
+ * round join at most a half width past a bevel. */
+static double joinDifference(const StrokeStyle& strokeStyle)
+{
+    double halfWidth = strokeStyle.lineWidth / 2.0;
+    if (strokeStyle.lineJoin == LineJoin::kMiter)
+        return halfWidth * fmax(strokeStyle.miterLimit - 1.0, 0.0);
+    if (strokeStyle.lineJoin == LineJoin::kBevel)
+        return halfWidth;
+    return 0;
+}
+
+void LodSVGRenderer::DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle)
+{
+    size_t index = mDraw++;
+    const LodSVGPath& lodPath = static_cast<const LodSVGPath&>(path);
+    GraphicStyle scratch;
+    const GraphicStyle& style = Unwrap(graphicStyle, scratch);
+    if (!mActive || index >= mDrawBounds.size() || boxIsEmpty(mDrawBounds[index]))
+    {
+        mRenderer->DrawPath(*lodPath.Wrapped(), style, fillStyle, strokeStyle);
+        return;
+    }
+
+    const Box& box = mDrawBounds[index];
+    double size = hypot(box.x1 - box.x0, box.y1 - box.y0) * mViewScale;
+    double scale = mDrawScales[index] * mViewScale;
+    if (size < kSkipSize || scale <= 0)
+    {
+        if (mCulling)
+            mCulling->SkipDraw();
+        return;
+    }
+    if (size < kDotSize)
+    {
+        DrawDot(lodPath, style, fillStyle, strokeStyle, scale);
+        return;
+    }
+    if (!strokeStyle.hasStroke || strokeStyle.lineWidth <= 0)
+    {
+        mRenderer->DrawPath(lodPath.Simplified(LOD_MAX_ERROR / scale, *mRenderer), style, fillStyle, strokeStyle);
+        return;
+    }
+
+    /* The corners simplifying adds would grow miters, and dashes would slide
+     * along the shorter path, so simplified strokes get round joins. What
+     * that changes at the path's own corners comes out of the error bound,
+     * and strokes where it would take more than half keep the exact path. */
+    double joinError = joinDifference(strokeStyle) * scale;
+    if (!strokeStyle.dashArray.empty() || joinError > LOD_MAX_ERROR / 2)
+    {
+        mRenderer->DrawPath(*lodPath.Wrapped(), style, fillStyle, strokeStyle);
+        return;
+    }
+    const Path& simplified = lodPath.Simplified((LOD_MAX_ERROR - joinError) / scale, *mRenderer);
+    if (&simplified == lodPath.Wrapped().get())
+    {
+        mRenderer->DrawPath(simplified, style, fillStyle, strokeStyle);
+        return;
+    }
+    StrokeStyle roundStroke = strokeStyle;
+    roundStroke.lineJoin = LineJoin::kRound;
+    mRenderer->DrawPath(simplified, style, fillStyle, roundStroke);
+}
+
+void LodSVGRenderer::DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea)
+{
+    mDraw++;
+    GraphicStyle scratch;
+    mRenderer->DrawImage(image, Unwrap(graphicStyle, scratch), clipArea, fillArea);
+}
+
+} // namespace SVGNative
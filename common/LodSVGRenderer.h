@@ -0,0 +1,106 @@
+#ifndef LOD_SVG_RENDERER_H
+#define LOD_SVG_RENDERER_H
+
+#include <vector>
+
+#include <svgnative/SVGRenderer.h>
+
+#include "GeometrySVGRenderer.h"
+#include "CullingSVGRenderer.h"
+
+/* Wraps another SVGNative port with a level of detail mode for zoomed out
+ * views. Every path also keeps its exact geometry, and draws are replaced by
+ * a simplified copy of the path at one of LOD_LEVELS tolerances: the
+ * coarsest one whose error, under the draw's transform and the view scale,
+ * stays within LOD_MAX_ERROR device pixels. Simplified strokes are drawn
+ * with round joins, and dashed strokes, or those whose joins differ from
+ * round by too much, keep the exact path. Elements smaller than a pixel are
+ * drawn as a one pixel dot, and those under a quarter pixel are skipped. Draw
+ * calls are matched to GeometrySVGRenderer's DrawBounds() and DrawScales() by
+ * order, like CullingSVGRenderer does.
+ *
+ * Paths only keep their geometry when the renderer is created enabled, and a
+ * disabled one passes everything through, so documents have to be parsed
+ * again to switch LOD on. */
+
+#define LOD_LEVELS 4
+#define LOD_MAX_ERROR 0.5
+
+namespace SVGNative
+{
+class LodSVGPath final : public Path
+{
+public:
+    LodSVGPath(std::unique_ptr<Path> path, bool recordGeometry);
+
+    void Rect(float x, float y, float width, float height) override;
+    void RoundedRect(float x, float y, float width, float height, float cornerRadiusX, float cornerRadiusY) override;
+    void Ellipse(float cx, float cy, float rx, float ry) override;
+
+    void MoveTo(float x, float y) override;
+    void LineTo(float x, float y) override;
+    void CurveTo(float x1, float y1, float x2, float y2, float x3, float y3) override;
+    void CurveToV(float x2, float y2, float x3, float y3) override;
+    void ClosePath() override;
+
+    const std::shared_ptr<Path>& Wrapped() const { return mPath; }
+    Box LocalBounds() const;
+    /* The path simplified within `tolerance` local units, created with
+     * `renderer` the first time a level is needed. The path itself when no
+     * level is coarse enough or simplifying saves nothing. */
+    const Path& Simplified(double tolerance, SVGRenderer& renderer) const;
+
+private:
+    std::shared_ptr<Path> mPath;
+    bool mRecordGeometry;
+    GeometrySVGPath mGeometry;
+    mutable bool mMeasured;
+    mutable Box mLocalBounds;
+    mutable bool mBuilt[LOD_LEVELS];
+    mutable std::unique_ptr<Path> mLevels[LOD_LEVELS];
+};
+
+class LodSVGRenderer final : public SVGRenderer
+{
+public:
+    LodSVGRenderer(std::shared_ptr<SVGRenderer> renderer, bool enabled);
+
+    std::unique_ptr<ImageData> CreateImageData(const std::string& base64, ImageEncoding encoding) override;
+    std::unique_ptr<Path> CreatePath() override;
+    std::unique_ptr<Transform> CreateTransform(float a = 1.0, float b = 0.0, float c = 0.0, float d = 1.0, float tx = 0.0, float ty = 0.0) override;
+
+    void Save(const GraphicStyle& graphicStyle) override;
+    void Restore() override;
+
+    void DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle) override;
+    void DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea) override;
+
+    /* GeometrySVGRenderer::DrawBounds() and DrawScales() of the document. */
+    void SetDraws(const std::vector<Box>& drawBounds, const std::vector<double>& drawScales);
+    bool Enabled() const { return mEnabled; }
+    /* The CullingSVGRenderer this one wraps, if any. The draws skipped for
+     * being too small are reported to it, as it matches calls to boxes by
+     * order too. */
+    void SetCulling(std::shared_ptr<CullingSVGRenderer> culling);
+    /* Simplifies for a view of `viewScale` device pixels per document unit
+     * until EndLod(), if enabled. Call right around SVGDocument::Render(). */
+    void BeginLod(double viewScale);
+    void EndLod();
+
+private:
+    const GraphicStyle& Unwrap(const GraphicStyle& graphicStyle, GraphicStyle& scratch) const;
+    void DrawDot(const LodSVGPath& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle, double scale);
+
+    std::shared_ptr<SVGRenderer> mRenderer;
+    std::shared_ptr<CullingSVGRenderer> mCulling;
+    bool mEnabled;
+    std::vector<Box> mDrawBounds;
+    std::vector<double> mDrawScales;
+    bool mActive;
+    double mViewScale;
+    size_t mDraw;
+};
+
+} // namespace SVGNative
+
+#endif
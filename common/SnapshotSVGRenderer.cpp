@@ -0,0 +1,502 @@
+#include "SnapshotSVGRenderer.h"
+#include "GeometrySVGRenderer.h"
+
+namespace SVGNative
+{
+SnapshotSVGPath::SnapshotSVGPath()
+    : mGeneration{0}
+    , mIndex{0}
+{
+}
+
+void SnapshotSVGPath::Add(SnapshotVerb verb, std::initializer_list<float> coords)
+{
+    mVerbs.push_back(verb);
+    mCoords.insert(mCoords.end(), coords);
+}
+
+void SnapshotSVGPath::Rect(float x, float y, float width, float height)
+{
+    Add(SNAPSHOT_RECT, {x, y, width, height});
+}
+
+void SnapshotSVGPath::RoundedRect(float x, float y, float width, float height, float cornerRadiusX, float cornerRadiusY)
+{
+    Add(SNAPSHOT_ROUNDED_RECT, {x, y, width, height, cornerRadiusX, cornerRadiusY});
+}
+
+void SnapshotSVGPath::Ellipse(float cx, float cy, float rx, float ry)
+{
+    Add(SNAPSHOT_ELLIPSE, {cx, cy, rx, ry});
+}
+
+void SnapshotSVGPath::MoveTo(float x, float y)
+{
+    Add(SNAPSHOT_MOVE_TO, {x, y});
+}
+
+void SnapshotSVGPath::LineTo(float x, float y)
+{
+    Add(SNAPSHOT_LINE_TO, {x, y});
+}
+
+void SnapshotSVGPath::CurveTo(float x1, float y1, float x2, float y2, float x3, float y3)
+{
+    Add(SNAPSHOT_CURVE_TO, {x1, y1, x2, y2, x3, y3});
+}
+
+void SnapshotSVGPath::CurveToV(float x2, float y2, float x3, float y3)
+{
+    Add(SNAPSHOT_CURVE_TO_V, {x2, y2, x3, y3});
+}
+
+void SnapshotSVGPath::ClosePath()
+{
+    Add(SNAPSHOT_CLOSE_PATH, {});
+}
+
+/* The size is read from the header, which is all parsing needs. */
+SnapshotSVGImageData::SnapshotSVGImageData(const std::string& base64, ImageEncoding encoding)
+    : mBase64{base64}
+    , mEncoding{encoding}
+    , mGeneration{0}
+    , mIndex{0}
+{
+    GeometrySVGImageData header(base64, encoding);
+    mWidth = header.Width();
+    mHeight = header.Height();
+}
+
+SnapshotSVGRenderer::SnapshotSVGRenderer()
+    : mGeneration{1}
+{
+    Reset();
+}
+
+void SnapshotSVGRenderer::Reset()
+{
+    mData = SnapshotData();
+    mData.path_verb_start.push_back(0);
+    mData.path_coord_start.push_back(0);
+    mGeneration++;
+}
+
+std::unique_ptr<ImageData> SnapshotSVGRenderer::CreateImageData(const std::string& base64, ImageEncoding encoding)
+{
+    return std::unique_ptr<ImageData>(new SnapshotSVGImageData(base64, encoding));
+}
+
+std::unique_ptr<Path> SnapshotSVGRenderer::CreatePath()
+{
+    return std::unique_ptr<Path>(new SnapshotSVGPath);
+}
+
+/* Transforms are stored by value when used, so the geometry engine's matrix
+ * transform is all that is needed here. */
+std::unique_ptr<Transform> SnapshotSVGRenderer::CreateTransform(float a, float b, float c, float d, float tx, float ty)
+{
+    return std::unique_ptr<Transform>(new GeometrySVGTransform(a, b, c, d, tx, ty));
+}
+
+void SnapshotSVGRenderer::AddOp(SnapshotOp op, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    mData.ops.push_back(op);
+    mData.op_args.push_back({a, b, c, d});
+}
+
+/* A path is stored the first time it is drawn, and every later draw of the
+ * same Path object refers back to it. */
+uint32_t SnapshotSVGRenderer::AddPath(const SnapshotSVGPath& path)
+{
+    if (path.mGeneration == mGeneration)
+        return path.mIndex;
+    path.mGeneration = mGeneration;
+    path.mIndex = static_cast<uint32_t>(mData.path_verb_start.size() - 1);
+    mData.verbs.insert(mData.verbs.end(), path.mVerbs.begin(), path.mVerbs.end());
+    mData.coords.insert(mData.coords.end(), path.mCoords.begin(), path.mCoords.end());
+    mData.path_verb_start.push_back(static_cast<uint32_t>(mData.verbs.size()));
+    mData.path_coord_start.push_back(static_cast<uint32_t>(mData.coords.size()));
+    return path.mIndex;
+}
+
+int32_t SnapshotSVGRenderer::AddTransform(const std::shared_ptr<Transform>& transform)
+{
+    if (!transform)
+        return -1;
+    Matrix m = static_cast<const GeometrySVGTransform*>(transform.get())->GetMatrix();
+    int32_t index = static_cast<int32_t>(mData.transforms.size() / 6);
+    float values[6] = {(float)m.a, (float)m.b, (float)m.c, (float)m.d, (float)m.tx, (float)m.ty};
+    mData.transforms.insert(mData.transforms.end(), values, values + 6);
+    return index;
+}
+
+uint32_t SnapshotSVGRenderer::AddStyle(const GraphicStyle& graphicStyle)
+{
+    SnapshotStyle style = {AddTransform(graphicStyle.transform), -1, graphicStyle.opacity,
+                           static_cast<uint32_t>(graphicStyle.blendMode)};
+    const ClippingPath* clip = graphicStyle.clippingPath.get();
+    if (clip && clip->path)
+    {
+        style.clip = static_cast<int32_t>(mData.clips.size());
+        SnapshotClip snapshotClip = {AddPath(static_cast<const SnapshotSVGPath&>(*clip->path)), AddTransform(clip->transform),
+                                     static_cast<uint32_t>(clip->clipRule), clip->hasClipContent ? 1u : 0u};
+        mData.clips.push_back(snapshotClip);
+    }
+    mData.styles.push_back(style);
+    return static_cast<uint32_t>(mData.styles.size() - 1);
+}
+
+uint32_t SnapshotSVGRenderer::AddPaint(const Paint& paint)
+{
+    SnapshotPaint snapshotPaint = {};
+    snapshotPaint.transform = -1;
+    if (holds_alternative<Color>(paint))
+    {
+        const Color& color = get<Color>(paint);
+        snapshotPaint.kind = SNAPSHOT_COLOR;
+        for (int i = 0; i < 4; i++)
+            snapshotPaint.color[i] = color[i];
+    }
+    else
+    {
+        const Gradient& gradient = get<Gradient>(paint);
+        snapshotPaint.kind = SNAPSHOT_GRADIENT;
+        snapshotPaint.gradient_type = static_cast<uint8_t>(gradient.type);
+        snapshotPaint.spread_method = static_cast<uint8_t>(gradient.method);
+        float coords[9] = {gradient.x1, gradient.y1, gradient.x2, gradient.y2, gradient.cx, gradient.cy, gradient.fx, gradient.fy, gradient.r};
+        for (int i = 0; i < 9; i++)
+            snapshotPaint.coords[i] = coords[i];
+        snapshotPaint.transform = AddTransform(gradient.transform);
+        snapshotPaint.stop_start = static_cast<uint32_t>(mData.stops.size() / 5);
+        snapshotPaint.stop_count = static_cast<uint32_t>(gradient.colorStops.size());
+        for (auto const& stop : gradient.colorStops)
+        {
+            mData.stops.push_back(stop.first);
+            mData.stops.insert(mData.stops.end(), stop.second.begin(), stop.second.end());
+        }
+    }
+    mData.paints.push_back(snapshotPaint);
+    return static_cast<uint32_t>(mData.paints.size() - 1);
+}
+
+uint32_t SnapshotSVGRenderer::AddFill(const FillStyle& fillStyle)
+{
+    SnapshotFill fill = {AddPaint(fillStyle.paint), fillStyle.fillOpacity, static_cast<uint32_t>(fillStyle.fillRule),
+                         fillStyle.hasFill ? 1u : 0u};
+    mData.fills.push_back(fill);
+    return static_cast<uint32_t>(mData.fills.size() - 1);
+}
+
+uint32_t SnapshotSVGRenderer::AddStroke(const StrokeStyle& strokeStyle)
+{
+    SnapshotStroke stroke = {};
+    stroke.paint = AddPaint(strokeStyle.paint);
+    stroke.opacity = strokeStyle.strokeOpacity;
+    stroke.line_width = strokeStyle.lineWidth;
+    stroke.miter_limit = strokeStyle.miterLimit;
+    stroke.dash_offset = strokeStyle.dashOffset;
+    stroke.dash_start = static_cast<uint32_t>(mData.dashes.size());
+    stroke.dash_count = static_cast<uint32_t>(strokeStyle.dashArray.size());
+    stroke.line_cap = static_cast<uint8_t>(strokeStyle.lineCap);
+    stroke.line_join = static_cast<uint8_t>(strokeStyle.lineJoin);
+    stroke.has_stroke = strokeStyle.hasStroke ? 1 : 0;
+    mData.dashes.insert(mData.dashes.end(), strokeStyle.dashArray.begin(), strokeStyle.dashArray.end());
+    mData.strokes.push_back(stroke);
+    return static_cast<uint32_t>(mData.strokes.size() - 1);
+}
+
+uint32_t SnapshotSVGRenderer::AddRect(const Rect& rect)
+{
+    float values[4] = {rect.x, rect.y, rect.width, rect.height};
+    mData.rects.insert(mData.rects.end(), values, values + 4);
+    return static_cast<uint32_t>(mData.rects.size() / 4 - 1);
+}
+
+uint32_t SnapshotSVGRenderer::AddImage(const SnapshotSVGImageData& image)
+{
+    if (image.mGeneration == mGeneration)
+        return image.mIndex;
+    image.mGeneration = mGeneration;
+    image.mIndex = static_cast<uint32_t>(mData.images.size());
+    SnapshotImage snapshotImage = {mData.bytes.size(), image.mBase64.size(), static_cast<uint32_t>(image.mEncoding), 0};
+    mData.bytes.insert(mData.bytes.end(), image.mBase64.begin(), image.mBase64.end());
+    mData.images.push_back(snapshotImage);
+    return image.mIndex;
+}
+
+void SnapshotSVGRenderer::Save(const GraphicStyle& graphicStyle)
+{
+    AddOp(SNAPSHOT_SAVE, AddStyle(graphicStyle));
+}
+
+void SnapshotSVGRenderer::Restore()
+{
+    AddOp(SNAPSHOT_RESTORE, 0);
+}
+
+void SnapshotSVGRenderer::DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle)
+{
+    AddOp(SNAPSHOT_DRAW_PATH, AddPath(static_cast<const SnapshotSVGPath&>(path)), AddStyle(graphicStyle),
+          AddFill(fillStyle), AddStroke(strokeStyle));
+}
+
+void SnapshotSVGRenderer::DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea)
+{
+    AddOp(SNAPSHOT_DRAW_IMAGE, AddImage(static_cast<const SnapshotSVGImageData&>(image)), AddStyle(graphicStyle),
+          AddRect(clipArea), AddRect(fillArea));
+}
+
+/* Every index, range and enum value in the snapshot is checked once here,
+ * so Render() can trust them and the casts to SVGNative enums stay in
+ * range. */
+bool SnapshotDocument::IsValid(const SVGSnapshot* snapshot)
+{
+    const SVGSnapshot& s = *snapshot;
+    auto optional = [](int32_t index, size_t count) { return index == -1 || (index >= 0 && (size_t)index < count); };
+    auto range = [](uint64_t start, uint64_t length, size_t count) { return start <= count && length <= count - start; };
+    auto upTo = [](uint32_t value, auto last) { return value <= static_cast<uint32_t>(last); };
+
+    if (s.path_verb_start[0] != 0 || s.path_coord_start[0] != 0 ||
+        s.path_verb_start[s.path_count] != s.verb_count || s.path_coord_start[s.path_count] != s.coord_count)
+        return false;
+    for (size_t i = 0; i < s.path_count; i++)
+    {
+        if (s.path_verb_start[i] > s.path_verb_start[i + 1] || s.path_coord_start[i] > s.path_coord_start[i + 1])
+            return false;
+        size_t coords = 0;
+        for (uint32_t v = s.path_verb_start[i]; v < s.path_verb_start[i + 1]; v++)
+        {
+            int count = snapshotVerbCoords(static_cast<SnapshotVerb>(s.verbs[v]));
+            if (count < 0)
+                return false;
+            coords += count;
+        }
+        if (coords != s.path_coord_start[i + 1] - s.path_coord_start[i])
+            return false;
+    }
+    for (size_t i = 0; i < s.style_count; i++)
+    {
+        if (!optional(s.styles[i].transform, s.transform_count) || !optional(s.styles[i].clip, s.clip_count) ||
+            !upTo(s.styles[i].blend_mode, BlendMode::kLuminosity))
+            return false;
+    }
+    for (size_t i = 0; i < s.clip_count; i++)
+    {
+        if (s.clips[i].path >= s.path_count || !optional(s.clips[i].transform, s.transform_count) ||
+            !upTo(s.clips[i].clip_rule, WindingRule::kEvenOdd))
+            return false;
+    }
+    for (size_t i = 0; i < s.paint_count; i++)
+    {
+        const SnapshotPaint& paint = s.paints[i];
+        if (!upTo(paint.kind, SNAPSHOT_GRADIENT) || !upTo(paint.gradient_type, GradientType::kRadialGradient) ||
+            !upTo(paint.spread_method, SpreadMethod::kRepeat))
+            return false;
+        if (!optional(paint.transform, s.transform_count) || !range(paint.stop_start, paint.stop_count, s.stop_count))
+            return false;
+    }
+    for (size_t i = 0; i < s.fill_count; i++)
+    {
+        if (s.fills[i].paint >= s.paint_count || !upTo(s.fills[i].fill_rule, WindingRule::kEvenOdd))
+            return false;
+    }
+    for (size_t i = 0; i < s.stroke_count; i++)
+    {
+        const SnapshotStroke& stroke = s.strokes[i];
+        if (stroke.paint >= s.paint_count || !range(stroke.dash_start, stroke.dash_count, s.dash_count) ||
+            !upTo(stroke.line_cap, LineCap::kSquare) || !upTo(stroke.line_join, LineJoin::kBevel))
+            return false;
+    }
+    for (size_t i = 0; i < s.image_count; i++)
+    {
+        if (!range(s.images[i].data_offset, s.images[i].data_size, s.byte_count) ||
+            !upTo(s.images[i].encoding, ImageEncoding::kJPEG))
+            return false;
+    }
+    int depth = 0;
+    for (size_t i = 0; i < s.op_count; i++)
+    {
+        const SnapshotOpArgs& args = s.op_args[i];
+        switch (s.ops[i])
+        {
+        case SNAPSHOT_SAVE:
+            if (args.a >= s.style_count)
+                return false;
+            depth++;
+            break;
+        case SNAPSHOT_RESTORE:
+            if (--depth < 0)
+                return false;
+            break;
+        case SNAPSHOT_DRAW_PATH:
+            if (args.a >= s.path_count || args.b >= s.style_count || args.c >= s.fill_count || args.d >= s.stroke_count)
+                return false;
+            break;
+        case SNAPSHOT_DRAW_IMAGE:
+            if (args.a >= s.image_count || args.b >= s.style_count || args.c >= s.rect_count || args.d >= s.rect_count)
+                return false;
+            break;
+        default:
+            return false;
+        }
+    }
+    return depth == 0;
+}
+
+SnapshotDocument* SnapshotDocument::CreateSnapshotDocument(const SVGSnapshot* snapshot, std::shared_ptr<SVGRenderer> renderer)
+{
+    if (!snapshot->mapping || !IsValid(snapshot))
+        return nullptr;
+    return new SnapshotDocument(snapshot, renderer);
+}
+
+Paint SnapshotDocument::CreatePaint(const SnapshotPaint& paint) const
+{
+    if (paint.kind == SNAPSHOT_COLOR)
+        return Color{{paint.color[0], paint.color[1], paint.color[2], paint.color[3]}};
+    Gradient gradient;
+    gradient.type = static_cast<GradientType>(paint.gradient_type);
+    gradient.method = static_cast<SpreadMethod>(paint.spread_method);
+    gradient.x1 = paint.coords[0];
+    gradient.y1 = paint.coords[1];
+    gradient.x2 = paint.coords[2];
+    gradient.y2 = paint.coords[3];
+    gradient.cx = paint.coords[4];
+    gradient.cy = paint.coords[5];
+    gradient.fx = paint.coords[6];
+    gradient.fy = paint.coords[7];
+    gradient.r = paint.coords[8];
+    if (paint.transform >= 0)
+        gradient.transform = mTransforms[paint.transform];
+    for (uint32_t i = 0; i < paint.stop_count; i++)
+    {
+        const float* stop = mSnapshot->stops + (paint.stop_start + i) * 5;
+        gradient.colorStops.push_back({stop[0], Color{{stop[1], stop[2], stop[3], stop[4]}}});
+    }
+    return gradient;
+}
+
+/* Creates the port objects up front, like parsing does, so that Render()
+ * only walks the ops. */
+SnapshotDocument::SnapshotDocument(const SVGSnapshot* snapshot, std::shared_ptr<SVGRenderer> renderer)
+    : mSnapshot{snapshot}
+    , mRenderer{renderer}
+{
+    const SVGSnapshot& s = *snapshot;
+    mPaths.reserve(s.path_count);
+    for (size_t i = 0; i < s.path_count; i++)
+    {
+        std::shared_ptr<Path> path = mRenderer->CreatePath();
+        const float* c = s.coords + s.path_coord_start[i];
+        for (uint32_t v = s.path_verb_start[i]; v < s.path_verb_start[i + 1]; v++)
+        {
+            switch (s.verbs[v])
+            {
+            case SNAPSHOT_RECT: path->Rect(c[0], c[1], c[2], c[3]); break;
+            case SNAPSHOT_ROUNDED_RECT: path->RoundedRect(c[0], c[1], c[2], c[3], c[4], c[5]); break;
+            case SNAPSHOT_ELLIPSE: path->Ellipse(c[0], c[1], c[2], c[3]); break;
+            case SNAPSHOT_MOVE_TO: path->MoveTo(c[0], c[1]); break;
+            case SNAPSHOT_LINE_TO: path->LineTo(c[0], c[1]); break;
+            case SNAPSHOT_CURVE_TO: path->CurveTo(c[0], c[1], c[2], c[3], c[4], c[5]); break;
+            case SNAPSHOT_CURVE_TO_V: path->CurveToV(c[0], c[1], c[2], c[3]); break;
+            case SNAPSHOT_CLOSE_PATH: path->ClosePath(); break;
+            }
+            c += snapshotVerbCoords(static_cast<SnapshotVerb>(s.verbs[v]));
+        }
+        mPaths.push_back(path);
+    }
+
+    mTransforms.reserve(s.transform_count);
+    for (size_t i = 0; i < s.transform_count; i++)
+    {
+        const float* t = s.transforms + i * 6;
+        mTransforms.push_back(mRenderer->CreateTransform(t[0], t[1], t[2], t[3], t[4], t[5]));
+    }
+
+    std::vector<std::shared_ptr<ClippingPath>> clips;
+    clips.reserve(s.clip_count);
+    for (size_t i = 0; i < s.clip_count; i++)
+    {
+        const SnapshotClip& clip = s.clips[i];
+        clips.push_back(std::make_shared<ClippingPath>(clip.has_clip_content != 0, static_cast<WindingRule>(clip.clip_rule), mPaths[clip.path],
+                                                       clip.transform >= 0 ? mTransforms[clip.transform] : nullptr));
+    }
+
+    mStyles.resize(s.style_count);
+    for (size_t i = 0; i < s.style_count; i++)
+    {
+        const SnapshotStyle& style = s.styles[i];
+        mStyles[i].blendMode = static_cast<BlendMode>(style.blend_mode);
+        mStyles[i].opacity = style.opacity;
+        if (style.transform >= 0)
+            mStyles[i].transform = mTransforms[style.transform];
+        if (style.clip >= 0)
+            mStyles[i].clippingPath = clips[style.clip];
+    }
+
+    mFills.resize(s.fill_count);
+    for (size_t i = 0; i < s.fill_count; i++)
+    {
+        const SnapshotFill& fill = s.fills[i];
+        mFills[i].hasFill = fill.has_fill != 0;
+        mFills[i].fillRule = static_cast<WindingRule>(fill.fill_rule);
+        mFills[i].fillOpacity = fill.opacity;
+        mFills[i].paint = CreatePaint(s.paints[fill.paint]);
+    }
+
+    mStrokes.resize(s.stroke_count);
+    for (size_t i = 0; i < s.stroke_count; i++)
+    {
+        const SnapshotStroke& stroke = s.strokes[i];
+        mStrokes[i].hasStroke = stroke.has_stroke != 0;
+        mStrokes[i].strokeOpacity = stroke.opacity;
+        mStrokes[i].lineWidth = stroke.line_width;
+        mStrokes[i].lineCap = static_cast<LineCap>(stroke.line_cap);
+        mStrokes[i].lineJoin = static_cast<LineJoin>(stroke.line_join);
+        mStrokes[i].miterLimit = stroke.miter_limit;
+        mStrokes[i].dashArray.assign(s.dashes + stroke.dash_start, s.dashes + stroke.dash_start + stroke.dash_count);
+        mStrokes[i].dashOffset = stroke.dash_offset;
+        mStrokes[i].paint = CreatePaint(s.paints[stroke.paint]);
+    }
+
+    mImages.reserve(s.image_count);
+    for (size_t i = 0; i < s.image_count; i++)
+    {
+        const SnapshotImage& image = s.images[i];
+        std::string base64(s.bytes + image.data_offset, image.data_size);
+        mImages.push_back(mRenderer->CreateImageData(base64, static_cast<ImageEncoding>(image.encoding)));
+    }
+}
+
+void SnapshotDocument::Render()
+{
+    const SVGSnapshot& s = *mSnapshot;
+    for (size_t i = 0; i < s.op_count; i++)
+    {
+        const SnapshotOpArgs& args = s.op_args[i];
+        switch (s.ops[i])
+        {
+        case SNAPSHOT_SAVE:
+            mRenderer->Save(mStyles[args.a]);
+            break;
+        case SNAPSHOT_RESTORE:
+            mRenderer->Restore();
+            break;
+        case SNAPSHOT_DRAW_PATH:
+            mRenderer->DrawPath(*mPaths[args.a], mStyles[args.b], mFills[args.c], mStrokes[args.d]);
+            break;
+        case SNAPSHOT_DRAW_IMAGE:
+        {
+            if (!mImages[args.a])
+                break;
+            const float* clip = s.rects + args.c * 4;
+            const float* fill = s.rects + args.d * 4;
+            mRenderer->DrawImage(*mImages[args.a], mStyles[args.b], Rect(clip[0], clip[1], clip[2], clip[3]),
+                                 Rect(fill[0], fill[1], fill[2], fill[3]));
+            break;
+        }
+        }
+    }
+}
+
+} // namespace SVGNative
@@ -0,0 +1,133 @@
+#ifndef SNAPSHOT_SVG_RENDERER_H
+#define SNAPSHOT_SVG_RENDERER_H
+
+#include <initializer_list>
+#include <vector>
+
+#include <svgnative/SVGRenderer.h>
+
+#include "snapshot.h"
+
+/* Recording and replaying snapshots (see snapshot.h). SnapshotSVGRenderer is
+ * a port that never draws: rendering a parsed SVGDocument through it fills
+ * in the snapshot sections. SnapshotDocument then stands in for SVGDocument:
+ * it creates the paths, transforms and images of a mapped snapshot with the
+ * given port once, and Render() replays the recorded calls into it.
+ *
+ * What a snapshot saves is the XML parse and style resolution, not the port
+ * objects: the ports only take SVGNative types, so creating a document still
+ * allocates a port path per recorded path, a dash vector per stroke, a stop
+ * vector per gradient and a copy of each image's base64 text, much like
+ * SVGDocument does. Only opening and validating the snapshot work in place. */
+
+namespace SVGNative
+{
+class SnapshotSVGPath final : public Path
+{
+public:
+    SnapshotSVGPath();
+
+    void Rect(float x, float y, float width, float height) override;
+    void RoundedRect(float x, float y, float width, float height, float cornerRadiusX, float cornerRadiusY) override;
+    void Ellipse(float cx, float cy, float rx, float ry) override;
+
+    void MoveTo(float x, float y) override;
+    void LineTo(float x, float y) override;
+    void CurveTo(float x1, float y1, float x2, float y2, float x3, float y3) override;
+    void CurveToV(float x2, float y2, float x3, float y3) override;
+    void ClosePath() override;
+
+private:
+    friend class SnapshotSVGRenderer;
+
+    void Add(SnapshotVerb verb, std::initializer_list<float> coords);
+
+    std::vector<uint8_t> mVerbs;
+    std::vector<float> mCoords;
+    /* The path's index in the snapshot being recorded, valid while
+     * mGeneration matches the renderer's. */
+    mutable uint64_t mGeneration;
+    mutable uint32_t mIndex;
+};
+
+class SnapshotSVGImageData final : public ImageData
+{
+public:
+    SnapshotSVGImageData(const std::string& base64, ImageEncoding encoding);
+
+    float Width() const override { return mWidth; }
+    float Height() const override { return mHeight; }
+
+private:
+    friend class SnapshotSVGRenderer;
+
+    std::string mBase64;
+    ImageEncoding mEncoding;
+    float mWidth;
+    float mHeight;
+    mutable uint64_t mGeneration;
+    mutable uint32_t mIndex;
+};
+
+class SnapshotSVGRenderer final : public SVGRenderer
+{
+public:
+    SnapshotSVGRenderer();
+
+    std::unique_ptr<ImageData> CreateImageData(const std::string& base64, ImageEncoding encoding) override;
+    std::unique_ptr<Path> CreatePath() override;
+    std::unique_ptr<Transform> CreateTransform(float a = 1.0, float b = 0.0, float c = 0.0, float d = 1.0, float tx = 0.0, float ty = 0.0) override;
+
+    void Save(const GraphicStyle& graphicStyle) override;
+    void Restore() override;
+
+    void DrawPath(const Path& path, const GraphicStyle& graphicStyle, const FillStyle& fillStyle, const StrokeStyle& strokeStyle) override;
+    void DrawImage(const ImageData& image, const GraphicStyle& graphicStyle, const Rect& clipArea, const Rect& fillArea) override;
+
+    /* Starts a new snapshot, forgetting the calls recorded so far. */
+    void Reset();
+    const SnapshotData& Data() const { return mData; }
+
+private:
+    void AddOp(SnapshotOp op, uint32_t a, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0);
+    uint32_t AddPath(const SnapshotSVGPath& path);
+    int32_t AddTransform(const std::shared_ptr<Transform>& transform);
+    uint32_t AddStyle(const GraphicStyle& graphicStyle);
+    uint32_t AddPaint(const Paint& paint);
+    uint32_t AddFill(const FillStyle& fillStyle);
+    uint32_t AddStroke(const StrokeStyle& strokeStyle);
+    uint32_t AddRect(const Rect& rect);
+    uint32_t AddImage(const SnapshotSVGImageData& image);
+
+    SnapshotData mData;
+    uint64_t mGeneration;
+};
+
+class SnapshotDocument final
+{
+public:
+    /* nullptr if the snapshot refers to records it doesn't have. The
+     * snapshot has to stay mapped for as long as the document is used. */
+    static SnapshotDocument* CreateSnapshotDocument(const SVGSnapshot* snapshot, std::shared_ptr<SVGRenderer> renderer);
+
+    void Render();
+
+private:
+    SnapshotDocument(const SVGSnapshot* snapshot, std::shared_ptr<SVGRenderer> renderer);
+
+    static bool IsValid(const SVGSnapshot* snapshot);
+    Paint CreatePaint(const SnapshotPaint& paint) const;
+
+    const SVGSnapshot* mSnapshot;
+    std::shared_ptr<SVGRenderer> mRenderer;
+    std::vector<std::shared_ptr<Path>> mPaths;
+    std::vector<std::shared_ptr<Transform>> mTransforms;
+    std::vector<GraphicStyle> mStyles;
+    std::vector<FillStyle> mFills;
+    std::vector<StrokeStyle> mStrokes;
+    std::vector<std::unique_ptr<ImageData>> mImages;
+};
+
+} // namespace SVGNative
+
+#endif
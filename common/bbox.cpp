@@ -0,0 +1,407 @@
+#include <unordered_set>
+
+#include <cairo.h>
+#include <librsvg/rsvg.h>
+
+#include <svgnative/SVGRenderer.h>
+#include <svgnative/SVGDocument.h>
+#include <core/SkCanvas.h>
+#include <core/SkPicture.h>
+#include <src/core/SkRTree.h>
+#include <SkPictureRecorder.h>
+
+#include "bbox.h"
+#include "svg-file.h"
+#include "SnapshotSVGRenderer.h"
+#include "raster-bounds.h"
+#include "trace.h"
+
+const char *bboxEngineName(BBoxEngine engine)
+{
+  switch (engine)
+  {
+    case BBOX_CAIRO: return "cairo";
+    case BBOX_SKIA: return "skia";
+    case BBOX_GEOMETRY: return "geometry";
+    case BBOX_LIBRSVG: return "librsvg";
+    case BBOX_RASTER: return "raster";
+  }
+  return "unknown";
+}
+
+bool bboxEngineHasElements(BBoxEngine engine)
+{
+  return engine != BBOX_RASTER && engine != BBOX_LIBRSVG;
+}
+
+void initializeBBoxWorker(BBoxWorker *worker)
+{
+  worker->cairo_renderer = std::make_shared<SVGNative::CairoSVGRenderer>();
+  worker->skia_renderer = std::make_shared<SVGNative::SkiaSVGRenderer>();
+  worker->geometry_renderer = std::make_shared<SVGNative::GeometrySVGRenderer>();
+  worker->cairo_bounds_renderer = std::make_shared<SVGNative::ImageCacheSVGRenderer>(worker->cairo_renderer, SVGNative::sharedImageCache());
+  worker->cairo_bounds_renderer->SetBoundsOnly(true);
+  worker->skia_bounds_renderer = std::make_shared<SVGNative::ImageCacheSVGRenderer>(worker->skia_renderer, SVGNative::sharedImageCache());
+  worker->skia_bounds_renderer->SetBoundsOnly(true);
+  worker->raster_renderer = std::make_shared<SVGNative::ImageCacheSVGRenderer>(worker->cairo_renderer, SVGNative::sharedImageCache());
+}
+
+int loadSnapshot(SVGFile *svg_file, std::string filename)
+{
+  TRACE_SCOPE("loadSnapshot");
+  svg_file->source.path = snapshotSourcePath(filename);
+  std::string snapshot_filename = snapshotFilename(svg_file->source.path);
+  if (svg_file->source.path.empty() || snapshot_filename.empty())
+    return 1;
+  if (openSnapshot(snapshot_filename, &svg_file->snapshot) == 0 && snapshotIsFresh(&svg_file->snapshot, &svg_file->source))
+    return 0;
+  closeSnapshot(&svg_file->snapshot);
+
+  auto recorder = std::make_shared<SVGNative::SnapshotSVGRenderer>();
+  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_file->data, recorder));
+  if (!doc)
+    return 1;
+  doc->Render();
+  if (writeSnapshot(snapshot_filename, &svg_file->source, &recorder->Data()))
+    return 1;
+  return openSnapshot(snapshot_filename, &svg_file->snapshot);
+}
+
+/* Renders the document into `renderer`, from its snapshot when the file has
+ * one and by parsing it otherwise. */
+static int renderDocument(SVGFile *svg_file, std::shared_ptr<SVGNative::SVGRenderer> renderer)
+{
+  if (svg_file->snapshot.mapping)
+  {
+    auto doc = std::unique_ptr<SVGNative::SnapshotDocument>(SVGNative::SnapshotDocument::CreateSnapshotDocument(&svg_file->snapshot, renderer));
+    if (doc)
+    {
+      doc->Render();
+      return 0;
+    }
+  }
+  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_file->data, renderer));
+  if (!doc)
+    return 1;
+  doc->Render();
+  return 0;
+}
+
+int calculateBoundingBoxCairo(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height)
+{
+  TRACE_SCOPE("calculateBoundingBoxCairo");
+  /* The recording surface accumulates ink, so it can't be reused across documents. */
+  cairo_surface_t *recording_surface = cairo_recording_surface_create(CAIRO_CONTENT_COLOR, NULL);
+  cairo_t* ct = cairo_create(recording_surface);
+  worker->cairo_renderer->SetCairo(ct);
+  int status = renderDocument(svg_file, worker->cairo_bounds_renderer);
+
+  if (status == 0)
+    cairo_recording_surface_ink_extents(recording_surface, x0, y0, width, height);
+  cairo_destroy(ct);
+  cairo_surface_flush(recording_surface);
+  cairo_surface_destroy(recording_surface);
+  return status;
+}
+
+int calculateBoundingBoxSkia(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height)
+{
+  TRACE_SCOPE("calculateBoundingBoxSkia");
+  SkRTreeFactory factory;
+  SkPictureRecorder skPictureRecorder;
+  SkRect cull = {-1000, -1000, 10000, 10000};
+  sk_sp<SkBBoxHierarchy> bbh = factory();
+  SkCanvas *canvas = skPictureRecorder.beginRecording(cull, bbh);
+
+  worker->skia_renderer->SetSkCanvas(canvas);
+  if (renderDocument(svg_file, worker->skia_bounds_renderer))
+    return 1;
+
+  SkRect rect;
+  sk_sp<SkPicture> pic = skPictureRecorder.finishRecordingAsPicture();
+  rect = pic->cullRect();
+
+  *x0 = rect.x();
+  *y0 = rect.y();
+  *width = rect.width();
+  *height = rect.height();
+  return 0;
+}
+
+int calculateBoundingBoxGeometry(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height)
+{
+  TRACE_SCOPE("calculateBoundingBoxGeometry");
+  worker->geometry_renderer->Reset(identityMatrix());
+  if (renderDocument(svg_file, worker->geometry_renderer))
+    return 1;
+
+  Box box = worker->geometry_renderer->DocumentBounds();
+  if (boxIsEmpty(box))
+  {
+    *x0 = *y0 = *width = *height = 0;
+    return 0;
+  }
+  *x0 = box.x0;
+  *y0 = box.y0;
+  *width = box.x1 - box.x0;
+  *height = box.y1 - box.y0;
+  return 0;
+}
+
+/* RsvgHandle isn't thread safe, so every call parses its own and unrefs it
+ * before returning. The viewport is the document size. */
+static RsvgHandle *openLibrsvgHandle(const char *data, size_t size, RsvgRectangle *viewport)
+{
+  GError *error = nullptr;
+  RsvgHandle *handle = rsvg_handle_new_from_data((const unsigned char*)data, size, &error);
+  if (!handle)
+  {
+    g_error_free(error);
+    return NULL;
+  }
+  RsvgDimensionData dimensions;
+  rsvg_handle_get_dimensions(handle, &dimensions);
+  *viewport = {0, 0, (double)dimensions.width, (double)dimensions.height};
+  return handle;
+}
+
+/* Ink rectangle of the element with `id`, or of the whole document for NULL,
+ * as drawn in the document. librsvg measures it without rendering. */
+static bool librsvgInk(RsvgHandle *handle, const char *id, RsvgRectangle *viewport, RsvgRectangle *ink)
+{
+  GError *error = nullptr;
+  RsvgRectangle logical;
+  gboolean ok = rsvg_handle_get_geometry_for_layer(handle, id, viewport, ink, &logical, &error);
+  if (error)
+    g_error_free(error);
+  return ok;
+}
+
+int calculateBoundingBoxLibrsvg(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height)
+{
+  TRACE_SCOPE("calculateBoundingBoxLibrsvg");
+  RsvgRectangle viewport, ink;
+  RsvgHandle *handle = openLibrsvgHandle(svg_file->data, svg_file->size, &viewport);
+  if (!handle)
+    return 1;
+  bool ok = librsvgInk(handle, NULL, &viewport, &ink);
+  g_object_unref(handle);
+  if (!ok)
+    return 1;
+
+  *x0 = ink.x;
+  *y0 = ink.y;
+  *width = ink.width;
+  *height = ink.height;
+  return 0;
+}
+
+int calculateBoundingBoxRaster(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height)
+{
+  TRACE_SCOPE("calculateBoundingBoxRaster");
+  cairo_surface_t *recording_surface = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, NULL);
+  cairo_t* ct = cairo_create(recording_surface);
+  worker->cairo_renderer->SetCairo(ct);
+  int status = renderDocument(svg_file, worker->raster_renderer);
+  cairo_destroy(ct);
+  if (status)
+  {
+    cairo_surface_destroy(recording_surface);
+    return 1;
+  }
+
+  /* Cairo's ink extents are conservative, so they bound the region worth
+   * rasterizing. The margin covers antialiasing spilling over them. */
+  double ex0, ey0, ewidth, eheight;
+  cairo_recording_surface_ink_extents(recording_surface, &ex0, &ey0, &ewidth, &eheight);
+  Box region = {ex0 - 1, ey0 - 1, ex0 + ewidth + 1, ey0 + eheight + 1};
+  Box ink = emptyBox();
+  if (ewidth > 0 && eheight > 0)
+    status = rasterInkBounds(recording_surface, region, RASTER_SCALE, &ink);
+  cairo_surface_destroy(recording_surface);
+
+  if (status)
+    return 1;
+  if (boxIsEmpty(ink))
+  {
+    *x0 = *y0 = *width = *height = 0;
+    return 0;
+  }
+  *x0 = ink.x0;
+  *y0 = ink.y0;
+  *width = ink.x1 - ink.x0;
+  *height = ink.y1 - ink.y0;
+  return 0;
+}
+
+int calculateBoundingBox(BBoxWorker *worker, BBoxEngine engine, SVGFile *svg_file, double *x0, double *y0, double *width, double *height)
+{
+  if (engine == BBOX_CAIRO)
+    return calculateBoundingBoxCairo(worker, svg_file, x0, y0, width, height);
+  if (engine == BBOX_GEOMETRY)
+    return calculateBoundingBoxGeometry(worker, svg_file, x0, y0, width, height);
+  if (engine == BBOX_LIBRSVG)
+    return calculateBoundingBoxLibrsvg(worker, svg_file, x0, y0, width, height);
+  if (engine == BBOX_RASTER)
+    return calculateBoundingBoxRaster(worker, svg_file, x0, y0, width, height);
+  return calculateBoundingBoxSkia(worker, svg_file, x0, y0, width, height);
+}
+
+int calculateBoundingBox(BBoxWorker *worker, BBoxEngine engine, std::string filename, double *x0, double *y0, double *width, double *height)
+{
+  SVGFile svg_file;
+  if (openSVGFile(filename, &svg_file))
+    return 1;
+  if (snapshotsEnabled())
+    loadSnapshot(&svg_file, filename);
+  int status = calculateBoundingBox(worker, engine, &svg_file, x0, y0, width, height);
+  closeSVGFile(&svg_file);
+  return status;
+}
+
+static Box boxFromRect(SVGNative::Rect const& rect)
+{
+  Box box = {rect.x, rect.y, rect.x + rect.width, rect.y + rect.height};
+  return box;
+}
+
+static Box boxFromExtents(double x0, double y0, double width, double height)
+{
+  if (width <= 0 && height <= 0)
+    return emptyBox();
+  Box box = {x0, y0, x0 + width, y0 + height};
+  return box;
+}
+
+/* Parses a copy of the document where every drawable element has an id, then
+ * asks for the ink rectangle of each id in turn. Elements librsvg doesn't
+ * draw, or draws nothing for, are left out like the other engines do. Each
+ * query walks the whole tree, so this is quadratic in the element count but
+ * never touches pixels. */
+static int calculateBoundingBoxesLibrsvg(SVGFile *svg_file, Box *document, std::vector<Box> *elements)
+{
+  TRACE_SCOPE("calculateBoundingBoxesLibrsvg");
+  std::string tagged;
+  std::vector<std::string> ids;
+  tagDrawableElements(svg_file, &tagged, &ids);
+
+  RsvgRectangle viewport, ink;
+  RsvgHandle *handle = openLibrsvgHandle(tagged.data(), tagged.size(), &viewport);
+  if (!handle)
+    return 1;
+  if (!librsvgInk(handle, NULL, &viewport, &ink))
+  {
+    g_object_unref(handle);
+    return 1;
+  }
+  *document = boxFromExtents(ink.x, ink.y, ink.width, ink.height);
+
+  std::unordered_set<std::string> seen;
+  for (auto const& id: ids)
+  {
+    /* Ids are taken from the raw attribute text, so one with an entity or a
+     * '#' wouldn't name the element in a "#id" query, and a repeated one
+     * names only the first element that has it. */
+    bool repeated = !seen.insert(id).second;
+    if (id.empty() || repeated || id.find_first_of("&#") != std::string::npos)
+      continue;
+    std::string selector = "#" + id;
+    if (!librsvgInk(handle, selector.c_str(), &viewport, &ink))
+      continue;
+    Box box = boxFromExtents(ink.x, ink.y, ink.width, ink.height);
+    if (!boxIsEmpty(box))
+      elements->push_back(box);
+  }
+  g_object_unref(handle);
+  return 0;
+}
+
+int calculateBoundingBoxes(BBoxWorker *worker, BBoxEngine engine, SVGFile *svg_file, Box *document, std::vector<Box> *elements)
+{
+  TRACE_SCOPE("calculateBoundingBoxes");
+  elements->clear();
+  double x0, y0, width, height;
+
+  if (engine == BBOX_CAIRO)
+  {
+    auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_file->data, worker->cairo_bounds_renderer));
+    if (!doc)
+      return 1;
+    cairo_surface_t *recording_surface = cairo_recording_surface_create(CAIRO_CONTENT_COLOR, NULL);
+    cairo_t* ct = cairo_create(recording_surface);
+    worker->cairo_renderer->SetCairo(ct);
+    for (auto const& rect: doc->Bounds())
+      elements->push_back(boxFromRect(rect));
+    doc->Render();
+    cairo_recording_surface_ink_extents(recording_surface, &x0, &y0, &width, &height);
+    cairo_destroy(ct);
+    cairo_surface_destroy(recording_surface);
+    *document = boxFromExtents(x0, y0, width, height);
+    return 0;
+  }
+
+  if (engine == BBOX_SKIA)
+  {
+    auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_file->data, worker->skia_bounds_renderer));
+    if (!doc)
+      return 1;
+    SkRTreeFactory factory;
+    SkPictureRecorder skPictureRecorder;
+    SkRect cull = {-1000, -1000, 10000, 10000};
+    sk_sp<SkBBoxHierarchy> bbh = factory();
+    SkCanvas *canvas = skPictureRecorder.beginRecording(cull, bbh);
+    worker->skia_renderer->SetSkCanvas(canvas);
+    doc->Render();
+    for (auto const& rect: doc->Bounds())
+      elements->push_back(boxFromRect(rect));
+    sk_sp<SkPicture> pic = skPictureRecorder.finishRecordingAsPicture();
+    SkRect rect = pic->cullRect();
+    *document = boxFromExtents(rect.x(), rect.y(), rect.width(), rect.height());
+    return 0;
+  }
+
+  if (engine == BBOX_GEOMETRY)
+  {
+    worker->geometry_renderer->Reset(identityMatrix());
+    if (renderDocument(svg_file, worker->geometry_renderer))
+      return 1;
+    *elements = worker->geometry_renderer->DrawBounds();
+    *document = worker->geometry_renderer->DocumentBounds();
+    return 0;
+  }
+
+  if (engine == BBOX_LIBRSVG)
+    return calculateBoundingBoxesLibrsvg(svg_file, document, elements);
+
+  if (calculateBoundingBox(worker, engine, svg_file, &x0, &y0, &width, &height))
+    return 1;
+  *document = boxFromExtents(x0, y0, width, height);
+  return 0;
+}
+
+int buildElementIndex(BBoxWorker *worker, SVGFile *svg_file, SpatialIndex *index)
+{
+  TRACE_SCOPE("buildElementIndex");
+  worker->geometry_renderer->Reset(identityMatrix());
+  if (renderDocument(svg_file, worker->geometry_renderer))
+  {
+    clearSpatialIndex(index);
+    return 1;
+  }
+  buildSpatialIndex(index, worker->geometry_renderer->ElementBounds(), worker->geometry_renderer->ElementParents());
+  return 0;
+}
+
+int calculateBoundingBoxCairo(std::string filename, double *x0, double *y0, double *width, double *height)
+{
+  BBoxWorker worker;
+  initializeBBoxWorker(&worker);
+  return calculateBoundingBox(&worker, BBOX_CAIRO, filename, x0, y0, width, height);
+}
+
+int calculateBoundingBoxSkia(std::string filename, double *x0, double *y0, double *width, double *height)
+{
+  BBoxWorker worker;
+  initializeBBoxWorker(&worker);
+  return calculateBoundingBox(&worker, BBOX_SKIA, filename, x0, y0, width, height);
+}
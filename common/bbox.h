@@ -0,0 +1,92 @@
+#ifndef BBOX_H
+#define BBOX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <svgnative/ports/cairo/CairoSVGRenderer.h>
+#include <svgnative/ports/skia/SkiaSVGRenderer.h>
+
+#include "GeometrySVGRenderer.h"
+#include "ImageCacheSVGRenderer.h"
+#include "spatial-index.h"
+#include "svg-file.h"
+
+#define RASTER_SCALE 4.0
+
+typedef enum _BBoxEngine {
+  BBOX_CAIRO = 0,
+  BBOX_SKIA = 1,
+  BBOX_GEOMETRY = 2,
+  BBOX_LIBRSVG = 3,
+  BBOX_RASTER = 4
+} BBoxEngine;
+
+#define BBOX_ENGINE_COUNT 5
+
+const char *bboxEngineName(BBoxEngine engine);
+/* Whether calculateBoundingBoxes reports per-element boxes for the engine
+ * that can be paired with another engine's by draw index. librsvg's are per
+ * element id instead, and the raster scan has none. */
+bool bboxEngineHasElements(BBoxEngine engine);
+
+/* Everything a thread needs to compute bounding boxes. One of these is owned
+ * by each worker so that renderers are never shared between threads.
+ * Documents are parsed through the ImageCacheSVGRenderer wrappers: the Cairo
+ * and Skia box queries never decode images, and the raster scan decodes each
+ * one at most once through the shared image cache. */
+typedef struct _BBoxWorker {
+  std::shared_ptr<SVGNative::CairoSVGRenderer> cairo_renderer;
+  std::shared_ptr<SVGNative::SkiaSVGRenderer> skia_renderer;
+  std::shared_ptr<SVGNative::GeometrySVGRenderer> geometry_renderer;
+  std::shared_ptr<SVGNative::ImageCacheSVGRenderer> cairo_bounds_renderer;
+  std::shared_ptr<SVGNative::ImageCacheSVGRenderer> skia_bounds_renderer;
+  std::shared_ptr<SVGNative::ImageCacheSVGRenderer> raster_renderer;
+} BBoxWorker;
+
+void initializeBBoxWorker(BBoxWorker *worker);
+
+/* Maps the snapshot of `filename` into svg_file, recording and writing it
+ * first when there is none or the file has changed since. Returns 0 if a
+ * snapshot is mapped, and 1 when snapshots are off or the file doesn't
+ * parse. */
+int loadSnapshot(SVGFile *svg_file, std::string filename);
+
+/* All of these return 0 on success and 1 if the document could not be
+ * parsed. The SVGFile versions work on an already loaded file, and replay
+ * its snapshot instead of parsing it when it has one. librsvg always reads
+ * the text, and the per-element Cairo and Skia boxes need
+ * SVGDocument::Bounds(), so those still parse. */
+int calculateBoundingBoxCairo(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height);
+int calculateBoundingBoxSkia(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height);
+/* Walks the document geometry analytically without rendering anything. */
+int calculateBoundingBoxGeometry(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height);
+/* Ink rectangle reported by rsvg_handle_get_geometry_for_layer for the whole
+ * document, with the viewport set to the document size. Each call parses and
+ * frees its own RsvgHandle, so workers never share one. */
+int calculateBoundingBoxLibrsvg(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height);
+/* Ground truth: renders the document with SNV + Cairo and scans the pixels
+ * for non-zero alpha, at RASTER_SCALE pixels per unit. */
+int calculateBoundingBoxRaster(BBoxWorker *worker, SVGFile *svg_file, double *x0, double *y0, double *width, double *height);
+int calculateBoundingBox(BBoxWorker *worker, BBoxEngine engine, SVGFile *svg_file, double *x0, double *y0, double *width, double *height);
+int calculateBoundingBox(BBoxWorker *worker, BBoxEngine engine, std::string filename, double *x0, double *y0, double *width, double *height);
+
+/* Document box plus one box per draw call, in call order and empty for a
+ * call that draws nothing, for the differential report to pair by draw
+ * index. The geometry engine keeps a box for every call; Cairo and Skia take
+ * SVGDocument::Bounds(), which the report can only pair when it has the same
+ * length. librsvg boxes come from one geometry query per element id, and are
+ * per <use> rather than per drawn shape, so they are counted but never
+ * paired; ids that can't be queried reliably are skipped. The raster scan can't split a
+ * document into elements and leaves `elements` empty. */
+int calculateBoundingBoxes(BBoxWorker *worker, BBoxEngine engine, SVGFile *svg_file, Box *document, std::vector<Box> *elements);
+
+/* Spatial index over the geometry engine's element boxes, with the group each
+ * element was drawn in, for hit testing. */
+int buildElementIndex(BBoxWorker *worker, SVGFile *svg_file, SpatialIndex *index);
+
+int calculateBoundingBoxCairo(std::string filename, double *x0, double *y0, double *width, double *height);
+int calculateBoundingBoxSkia(std::string filename, double *x0, double *y0, double *width, double *height);
+
+#endif
@@ -0,0 +1,444 @@
+#include <cmath>
+
+#include "clip-bounds.h"
+
+static const double EPSILON = 1e-9;
+
+static Point sub(Point a, Point b)
+{
+  Point p = {a.x - b.x, a.y - b.y};
+  return p;
+}
+
+static double cross(Point a, Point b)
+{
+  return a.x * b.y - a.y * b.x;
+}
+
+/* Appends the points of a segment after its start, in local space, spaced
+ * so the chords stay within `tolerance` local units of the curve. */
+static void flattenSegment(const Segment *segment, double tolerance, std::vector<Point> *points)
+{
+  int count = 1;
+  if (segment->type == SEGMENT_CUBIC)
+  {
+    Point dd0 = {segment->p[0].x - 2 * segment->p[1].x + segment->p[2].x, segment->p[0].y - 2 * segment->p[1].y + segment->p[2].y};
+    Point dd1 = {segment->p[1].x - 2 * segment->p[2].x + segment->p[3].x, segment->p[1].y - 2 * segment->p[2].y + segment->p[3].y};
+    double dd = fmax(length(dd0), length(dd1));
+    count = (int)ceil(sqrt(0.75 * dd / tolerance));
+  }
+  else if (segment->type == SEGMENT_ARC)
+  {
+    double radius = fmax(fabs(segment->radii.x), fabs(segment->radii.y));
+    double step = radius > tolerance ? 2 * acos(1 - tolerance / radius) : M_PI / 2;
+    count = (int)ceil(fabs(segment->sweep) / step);
+  }
+  if (count < 1)
+    count = 1;
+  if (count > 1024)
+    count = 1024;
+  for (int i = 1; i <= count; i++)
+    points->push_back(segmentPoint(segment, (double)i / count));
+}
+
+static void finishPolygon(Polygon *polygon)
+{
+  polygon->box = emptyBox();
+  for (auto const& contour: polygon->contours)
+  {
+    for (auto const& p: contour)
+      boxAddPoint(&polygon->box, p);
+  }
+}
+
+void flattenPath(const PathGeometry *path, Matrix m, double tolerance, bool even_odd, Polygon *polygon)
+{
+  double local_tolerance = tolerance / fmax(matrixScale(m), EPSILON);
+  polygon->contours.clear();
+  polygon->even_odd = even_odd;
+  for (auto const& subpath: path->subpaths)
+  {
+    if (subpath.segments.empty())
+      continue;
+    std::vector<Point> contour;
+    contour.push_back(subpath.segments.front().p[0]);
+    for (auto const& segment: subpath.segments)
+      flattenSegment(&segment, local_tolerance, &contour);
+    for (auto& p: contour)
+      p = transformPoint(m, p);
+    polygon->contours.push_back(contour);
+  }
+  finishPolygon(polygon);
+}
+
+static void addPiece(std::vector<Point> const& local, Matrix m, std::vector<Polygon> *pieces)
+{
+  Polygon piece;
+  piece.even_odd = false;
+  std::vector<Point> contour;
+  for (auto const& p: local)
+    contour.push_back(transformPoint(m, p));
+  piece.contours.push_back(contour);
+  finishPolygon(&piece);
+  pieces->push_back(piece);
+}
+
+static Point offset(Point p, Point n, double h)
+{
+  Point q = {p.x + n.x * h, p.y + n.y * h};
+  return q;
+}
+
+static Point unitNormal(Point a, Point b)
+{
+  Point d = sub(b, a);
+  double l = length(d);
+  Point n = {0, 0};
+  if (l > EPSILON)
+  {
+    n.x = -d.y / l;
+    n.y = d.x / l;
+  }
+  return n;
+}
+
+/* A regular polygon circumscribing the disk of radius h around p. */
+static void addDisk(Point p, double h, Matrix m, std::vector<Polygon> *pieces)
+{
+  const int sides = 16;
+  double r = h / cos(M_PI / sides);
+  std::vector<Point> disk;
+  for (int i = 0; i < sides; i++)
+  {
+    double angle = 2 * M_PI * i / sides;
+    Point q = {p.x + r * cos(angle), p.y + r * sin(angle)};
+    disk.push_back(q);
+  }
+  addPiece(disk, m, pieces);
+}
+
+static void addCap(Point p, Point n, Point outward, const StrokeParams *stroke, Matrix m, std::vector<Polygon> *pieces)
+{
+  double h = stroke->width / 2;
+  if (stroke->cap == CAP_ROUND)
+    addDisk(p, h, m, pieces);
+  else if (stroke->cap == CAP_SQUARE)
+  {
+    Point far = offset(p, outward, h);
+    std::vector<Point> square = {offset(p, n, h), offset(far, n, h), offset(far, n, -h), offset(p, n, -h)};
+    addPiece(square, m, pieces);
+  }
+}
+
+static void addJoin(Point p, Point n_in, Point n_out, const StrokeParams *stroke, Matrix m, std::vector<Polygon> *pieces)
+{
+  double h = stroke->width / 2;
+  if (stroke->join == JOIN_ROUND)
+  {
+    addDisk(p, h, m, pieces);
+    return;
+  }
+  /* Put the outer side first: it is where the two offset edges part. */
+  double turn = cross(n_in, n_out);
+  double side = turn > 0 ? -1 : 1;
+  Point a = {n_in.x * side, n_in.y * side};
+  Point b = {n_out.x * side, n_out.y * side};
+  std::vector<Point> join = {p, offset(p, a, h)};
+  double cosine = dot(n_in, n_out);
+  double half_cos = sqrt(fmax(0.0, (1 + cosine) / 2));
+  if (stroke->join == JOIN_MITER && half_cos > EPSILON && 1.0 / half_cos <= stroke->miter_limit)
+  {
+    Point bisector = {a.x + b.x, a.y + b.y};
+    double l = length(bisector);
+    if (l > EPSILON)
+      join.push_back(offset(p, {bisector.x / l, bisector.y / l}, h / half_cos));
+  }
+  join.push_back(offset(p, b, h));
+  addPiece(join, m, pieces);
+}
+
+void strokePieces(const PathGeometry *path, const StrokeParams *stroke, Matrix m, double tolerance, std::vector<Polygon> *pieces)
+{
+  PathGeometry dashed;
+  if (dashPath(path, stroke->dashes, stroke->dash_offset, &dashed))
+    path = &dashed;
+
+  double h = stroke->width / 2;
+  double local_tolerance = tolerance / fmax(matrixScale(m), EPSILON);
+  for (auto const& subpath: path->subpaths)
+  {
+    if (subpath.segments.empty())
+      continue;
+
+    /* Flatten, remembering where the original segments meet so real joins
+     * get the join style while chord vertices inside a curve are bridged. */
+    std::vector<Point> points;
+    std::vector<bool> corner;
+    points.push_back(subpath.segments.front().p[0]);
+    corner.push_back(true);
+    for (auto const& segment: subpath.segments)
+    {
+      size_t before = points.size();
+      flattenSegment(&segment, local_tolerance, &points);
+      for (size_t i = before; i < points.size(); i++)
+        corner.push_back(i + 1 == points.size());
+    }
+
+    /* Drop repeated points so every edge has a direction. */
+    std::vector<Point> unique;
+    std::vector<bool> unique_corner;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+      if (!unique.empty() && length(sub(points[i], unique.back())) <= EPSILON)
+      {
+        unique_corner.back() = unique_corner.back() || corner[i];
+        continue;
+      }
+      unique.push_back(points[i]);
+      unique_corner.push_back(corner[i]);
+    }
+    if (subpath.closed && unique.size() > 1 && length(sub(unique.front(), unique.back())) <= EPSILON)
+    {
+      unique.pop_back();
+      unique_corner.pop_back();
+    }
+
+    if (unique.size() == 1)
+    {
+      /* A zero length subpath only paints its caps. */
+      if (stroke->cap == CAP_ROUND)
+        addDisk(unique[0], h, m, pieces);
+      else if (stroke->cap == CAP_SQUARE)
+      {
+        Point p = unique[0];
+        std::vector<Point> square = {{p.x - h, p.y - h}, {p.x + h, p.y - h}, {p.x + h, p.y + h}, {p.x - h, p.y + h}};
+        addPiece(square, m, pieces);
+      }
+      continue;
+    }
+
+    size_t count = unique.size();
+    size_t edges = subpath.closed ? count : count - 1;
+    for (size_t i = 0; i < edges; i++)
+    {
+      Point a = unique[i];
+      Point b = unique[(i + 1) % count];
+      Point n = unitNormal(a, b);
+      std::vector<Point> quad = {offset(a, n, h), offset(b, n, h), offset(b, n, -h), offset(a, n, -h)};
+      addPiece(quad, m, pieces);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      bool has_in = subpath.closed || i > 0;
+      bool has_out = subpath.closed || i + 1 < count;
+      if (!has_in || !has_out)
+        continue;
+      Point p = unique[i];
+      Point n_in = unitNormal(unique[(i + count - 1) % count], p);
+      Point n_out = unitNormal(p, unique[(i + 1) % count]);
+      if (unique_corner[i])
+        addJoin(p, n_in, n_out, stroke, m, pieces);
+      else
+      {
+        std::vector<Point> bridge = {offset(p, n_in, h), offset(p, n_out, h), offset(p, n_in, -h), offset(p, n_out, -h)};
+        addPiece(bridge, m, pieces);
+      }
+    }
+
+    if (!subpath.closed)
+    {
+      Point start_out = sub(unique[0], unique[1]);
+      start_out = {start_out.x / length(start_out), start_out.y / length(start_out)};
+      addCap(unique[0], unitNormal(unique[0], unique[1]), start_out, stroke, m, pieces);
+      Point end_out = sub(unique[count - 1], unique[count - 2]);
+      end_out = {end_out.x / length(end_out), end_out.y / length(end_out)};
+      addCap(unique[count - 1], unitNormal(unique[count - 2], unique[count - 1]), end_out, stroke, m, pieces);
+    }
+  }
+}
+
+static bool onSegment(Point p, Point a, Point b)
+{
+  Point ab = sub(b, a);
+  Point ap = sub(p, a);
+  double l = length(ab);
+  if (l <= EPSILON)
+    return length(ap) <= 1e-7;
+  if (fabs(cross(ab, ap)) / l > 1e-7)
+    return false;
+  double t = dot(ap, ab) / (l * l);
+  return t >= -EPSILON && t <= 1 + EPSILON;
+}
+
+/* Points on the outline count as inside, so shared edges don't lose their
+ * corners. */
+static bool pointInPolygon(const Polygon *polygon, Point p)
+{
+  if (p.x < polygon->box.x0 - 1e-7 || p.x > polygon->box.x1 + 1e-7 ||
+      p.y < polygon->box.y0 - 1e-7 || p.y > polygon->box.y1 + 1e-7)
+    return false;
+  int winding = 0;
+  for (auto const& contour: polygon->contours)
+  {
+    size_t count = contour.size();
+    for (size_t i = 0; i < count; i++)
+    {
+      Point a = contour[i];
+      Point b = contour[(i + 1) % count];
+      if (onSegment(p, a, b))
+        return true;
+      double side = cross(sub(b, a), sub(p, a));
+      if (a.y <= p.y)
+      {
+        if (b.y > p.y && side > 0)
+          winding++;
+      }
+      else if (b.y <= p.y && side < 0)
+        winding--;
+    }
+  }
+  return polygon->even_odd ? (winding & 1) != 0 : winding != 0;
+}
+
+static size_t edgeCount(const Polygon *polygon)
+{
+  size_t count = 0;
+  for (auto const& contour: polygon->contours)
+    count += contour.size();
+  return count;
+}
+
+/* Calls add(p) for every crossing of an edge of a with an edge of b that
+ * falls inside `window`. */
+template<typename Add>
+static void forEachCrossing(const Polygon *a, const Polygon *b, Box window, Add add)
+{
+  for (auto const& ca: a->contours)
+  {
+    for (size_t ea = 0; ea < ca.size(); ea++)
+    {
+      Point p0 = ca[ea];
+      Point p1 = ca[(ea + 1) % ca.size()];
+      if (fmax(p0.x, p1.x) < window.x0 || fmin(p0.x, p1.x) > window.x1 ||
+          fmax(p0.y, p1.y) < window.y0 || fmin(p0.y, p1.y) > window.y1)
+        continue;
+      Point r = sub(p1, p0);
+      for (auto const& cb: b->contours)
+      {
+        for (size_t eb = 0; eb < cb.size(); eb++)
+        {
+          Point q0 = cb[eb];
+          Point q1 = cb[(eb + 1) % cb.size()];
+          Point s = sub(q1, q0);
+          double denom = cross(r, s);
+          if (fabs(denom) <= EPSILON)
+            continue;
+          Point qp = sub(q0, p0);
+          double t = cross(qp, s) / denom;
+          double u = cross(qp, r) / denom;
+          if (t < 0 || t > 1 || u < 0 || u > 1)
+            continue;
+          Point p = {p0.x + t * r.x, p0.y + t * r.y};
+          add(p);
+        }
+      }
+    }
+  }
+}
+
+static bool insideAll(std::vector<Polygon> const& shapes, Point p, size_t skip)
+{
+  for (size_t k = 0; k < shapes.size(); k++)
+  {
+    if (k != skip && !pointInPolygon(&shapes[k], p))
+      return false;
+  }
+  return true;
+}
+
+void initializeClipRegion(ClipRegion *clip)
+{
+  clip->shapes.clear();
+  clip->corners.clear();
+  clip->box = {-INFINITY, -INFINITY, INFINITY, INFINITY};
+}
+
+bool addClipShape(ClipRegion *clip, Polygon const& shape, size_t budget)
+{
+  size_t shape_edges = edgeCount(&shape);
+  size_t clip_edges = 0;
+  for (auto const& other: clip->shapes)
+    clip_edges += edgeCount(&other);
+  if (clip->corners.size() * shape_edges + 2 * shape_edges * clip_edges > budget)
+    return false;
+
+  std::vector<Point> corners;
+  for (auto const& p: clip->corners)
+  {
+    if (pointInPolygon(&shape, p))
+      corners.push_back(p);
+  }
+  for (auto const& contour: shape.contours)
+  {
+    for (auto const& p: contour)
+    {
+      if (insideAll(clip->shapes, p, clip->shapes.size()))
+        corners.push_back(p);
+    }
+  }
+  Box window = boxIntersect(clip->box, shape.box);
+  for (size_t i = 0; i < clip->shapes.size(); i++)
+  {
+    forEachCrossing(&shape, &clip->shapes[i], window, [&](Point p) {
+      if (insideAll(clip->shapes, p, i))
+        corners.push_back(p);
+    });
+  }
+  clip->shapes.push_back(shape);
+  clip->corners = corners;
+  clip->box = window;
+  return true;
+}
+
+bool clippedBounds(const Polygon *subject, const ClipRegion *clip, size_t budget, Box *box)
+{
+  Box window = boxIntersect(subject->box, clip->box);
+  if (boxIsEmpty(window))
+  {
+    *box = emptyBox();
+    return true;
+  }
+
+  size_t subject_edges = edgeCount(subject);
+  size_t clip_edges = 0;
+  for (auto const& shape: clip->shapes)
+    clip_edges += edgeCount(&shape);
+  if (subject_edges * clip_edges + clip->corners.size() * subject_edges > budget)
+    return false;
+
+  Box result = emptyBox();
+  for (auto const& p: clip->corners)
+  {
+    if (pointInPolygon(subject, p))
+      boxAddPoint(&result, p);
+  }
+  for (auto const& contour: subject->contours)
+  {
+    for (auto const& p: contour)
+    {
+      if (p.x >= window.x0 && p.x <= window.x1 && p.y >= window.y0 && p.y <= window.y1 &&
+          insideAll(clip->shapes, p, clip->shapes.size()))
+        boxAddPoint(&result, p);
+    }
+  }
+  for (size_t i = 0; i < clip->shapes.size(); i++)
+  {
+    forEachCrossing(subject, &clip->shapes[i], window, [&](Point p) {
+      if (insideAll(clip->shapes, p, i))
+        boxAddPoint(&result, p);
+    });
+  }
+  *box = result;
+  return true;
+}
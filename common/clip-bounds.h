@@ -0,0 +1,48 @@
+#ifndef CLIP_BOUNDS_H
+#define CLIP_BOUNDS_H
+
+#include <vector>
+
+#include "geometry.h"
+#include "stroke-bounds.h"
+
+/* Flattened outline in device space. */
+typedef struct _Polygon {
+  std::vector<std::vector<Point>> contours;
+  bool even_odd;
+  Box box;
+} Polygon;
+
+/* Flattens a path under m so that no point is further than `tolerance`
+ * device units from the true outline. */
+void flattenPath(const PathGeometry *path, Matrix m, double tolerance, bool even_odd, Polygon *polygon);
+
+/* Covers the stroke of a path with small convex pieces (one per flattened
+ * edge, join and cap) whose union contains the stroke. Built in local space
+ * and then mapped by m, so the pen stays exact under non uniform scales. */
+void strokePieces(const PathGeometry *path, const StrokeParams *stroke, Matrix m, double tolerance, std::vector<Polygon> *pieces);
+
+/* The intersection of every clip path in effect. `corners` holds the points
+ * that can be extremes of that intersection: vertices of one clip inside all
+ * the others and crossings of two clips' edges inside the rest. */
+typedef struct _ClipRegion {
+  std::vector<Polygon> shapes;
+  std::vector<Point> corners;
+  Box box;
+} ClipRegion;
+
+void initializeClipRegion(ClipRegion *clip);
+/* Intersects the region with shape. Returns false without touching *clip
+ * when finding the new corners would take more than `budget` edge tests, in
+ * which case callers fall back to the clip boxes. */
+bool addClipShape(ClipRegion *clip, Polygon const& shape, size_t budget);
+
+/* Bounds of subject intersected with the clip region. The extremes of a
+ * polygon intersection lie at vertices of one shape inside all the others or
+ * at crossings of two shapes' edges inside the rest, so only those points
+ * are visited. Returns false without touching *box when that would take more
+ * than `budget` edge tests, in which case callers fall back to intersecting
+ * boxes. */
+bool clippedBounds(const Polygon *subject, const ClipRegion *clip, size_t budget, Box *box);
+
+#endif
@@ -0,0 +1,109 @@
+#include <cmath>
+#include <algorithm>
+
+#include "frame.h"
+
+/* Past this many rectangles, or this share of the window, one bounding
+ * rectangle (or the whole window) is cheaper to present. */
+#define MAX_DAMAGE_RECTS 16
+#define FULL_DAMAGE_SHARE 0.5
+
+void initializeFrame(Frame *frame, SDL_Window *window, int width, int height)
+{
+  frame->window = window;
+  frame->width = width;
+  frame->height = height;
+  frame->full = false;
+  frame->damage.clear();
+  frame->present_ms = 0;
+  frame->present_rects = 0;
+  frame->frames = 0;
+  frame->total_present_ms = 0;
+}
+
+void damageFrame(Frame *frame, int x, int y, int width, int height)
+{
+  if (frame->full)
+    return;
+  int x0 = std::max(x, 0), y0 = std::max(y, 0);
+  int x1 = std::min(x + width, frame->width), y1 = std::min(y + height, frame->height);
+  if (x0 >= x1 || y0 >= y1)
+    return;
+  SDL_Rect rect = {x0, y0, x1 - x0, y1 - y0};
+  frame->damage.push_back(rect);
+}
+
+void damageFrameAll(Frame *frame)
+{
+  frame->full = true;
+  frame->damage.clear();
+}
+
+void damageFrameUserBox(Frame *frame, cairo_t *cr, double x0, double y0, double x1, double y1, double pad)
+{
+  double xs[4] = {x0, x1, x1, x0}, ys[4] = {y0, y0, y1, y1};
+  double dx0 = INFINITY, dy0 = INFINITY, dx1 = -INFINITY, dy1 = -INFINITY;
+  for (int i = 0; i < 4; i++)
+  {
+    cairo_user_to_device(cr, &xs[i], &ys[i]);
+    dx0 = std::min(dx0, xs[i]);
+    dy0 = std::min(dy0, ys[i]);
+    dx1 = std::max(dx1, xs[i]);
+    dy1 = std::max(dy1, ys[i]);
+  }
+  /* Boxes far outside the window would overflow int. */
+  dx0 = std::max(dx0 - pad, -1.0);
+  dy0 = std::max(dy0 - pad, -1.0);
+  dx1 = std::min(dx1 + pad, frame->width + 1.0);
+  dy1 = std::min(dy1 + pad, frame->height + 1.0);
+  if (dx0 >= dx1 || dy0 >= dy1)
+    return;
+  int x = (int)floor(dx0), y = (int)floor(dy0);
+  damageFrame(frame, x, y, (int)ceil(dx1) - x, (int)ceil(dy1) - y);
+}
+
+/* Folds the damage into one bounding rectangle when there are too many
+ * pieces, and into the whole window when that covers most of it anyway. */
+static void coalesceDamage(Frame *frame)
+{
+  if (frame->full || frame->damage.empty())
+    return;
+  SDL_Rect bounds = frame->damage[0];
+  double area = 0;
+  for (auto const& rect: frame->damage)
+  {
+    SDL_UnionRect(&bounds, &rect, &bounds);
+    area += (double)rect.w * rect.h;
+  }
+  double window_area = (double)frame->width * frame->height;
+  if ((double)bounds.w * bounds.h > FULL_DAMAGE_SHARE * window_area)
+    damageFrameAll(frame);
+  else if (frame->damage.size() > MAX_DAMAGE_RECTS || area >= (double)bounds.w * bounds.h)
+    frame->damage.assign(1, bounds);
+}
+
+void presentFrame(Frame *frame)
+{
+  if (!frame->full && frame->damage.empty())
+    return;
+  coalesceDamage(frame);
+
+  uint64_t start = SDL_GetPerformanceCounter();
+  if (frame->full)
+  {
+    SDL_UpdateWindowSurface(frame->window);
+    frame->present_rects = 1;
+  }
+  else
+  {
+    SDL_UpdateWindowSurfaceRects(frame->window, frame->damage.data(), (int)frame->damage.size());
+    frame->present_rects = (int)frame->damage.size();
+  }
+  uint64_t end = SDL_GetPerformanceCounter();
+
+  frame->present_ms = (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+  frame->total_present_ms += frame->present_ms;
+  frame->frames++;
+  frame->full = false;
+  frame->damage.clear();
+}
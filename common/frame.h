@@ -0,0 +1,37 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <vector>
+#include <cstdint>
+
+#include <SDL2/SDL.h>
+#include <cairo.h>
+
+/* Collects the parts of the window surface drawn during a frame so the frame
+ * is presented once, with SDL_UpdateWindowSurfaceRects, instead of after
+ * every draw call. */
+typedef struct _Frame {
+  SDL_Window *window;
+  int width;
+  int height;
+  bool full;
+  std::vector<SDL_Rect> damage;
+  /* Cost of the last present and a running total, for the info boxes. */
+  double present_ms;
+  int present_rects;
+  uint64_t frames;
+  double total_present_ms;
+} Frame;
+
+void initializeFrame(Frame *frame, SDL_Window *window, int width, int height);
+
+void damageFrame(Frame *frame, int x, int y, int width, int height);
+void damageFrameAll(Frame *frame);
+/* Damages the device space bounds of a user space box under cr's current
+ * matrix, grown by `pad` device pixels for line widths and antialiasing. */
+void damageFrameUserBox(Frame *frame, cairo_t *cr, double x0, double y0, double x1, double y1, double pad);
+
+/* Presents what was damaged since the last call, if anything. */
+void presentFrame(Frame *frame);
+
+#endif
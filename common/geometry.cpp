@@ -0,0 +1,239 @@
+#include <cmath>
+#include <limits>
+
+#include "geometry.h"
+
+Matrix identityMatrix()
+{
+  Matrix m = {1, 0, 0, 1, 0, 0};
+  return m;
+}
+
+Matrix matrixMultiply(Matrix outer, Matrix inner)
+{
+  Matrix m;
+  m.a = outer.a * inner.a + outer.c * inner.b;
+  m.b = outer.b * inner.a + outer.d * inner.b;
+  m.c = outer.a * inner.c + outer.c * inner.d;
+  m.d = outer.b * inner.c + outer.d * inner.d;
+  m.tx = outer.a * inner.tx + outer.c * inner.ty + outer.tx;
+  m.ty = outer.b * inner.tx + outer.d * inner.ty + outer.ty;
+  return m;
+}
+
+/* The spectral norm: the square root of the larger eigenvalue of M^T M. The
+ * column lengths alone fall short by up to sqrt(2) under shear. */
+double matrixScale(Matrix m)
+{
+  double sum = m.a * m.a + m.b * m.b + m.c * m.c + m.d * m.d;
+  double difference = m.a * m.a + m.b * m.b - m.c * m.c - m.d * m.d;
+  double product = m.a * m.c + m.b * m.d;
+  return sqrt((sum + sqrt(difference * difference + 4 * product * product)) / 2);
+}
+
+Point transformPoint(Matrix m, Point p)
+{
+  Point q = {m.a * p.x + m.c * p.y + m.tx, m.b * p.x + m.d * p.y + m.ty};
+  return q;
+}
+
+double dot(Point a, Point b)
+{
+  return a.x * b.x + a.y * b.y;
+}
+
+double length(Point p)
+{
+  return sqrt(p.x * p.x + p.y * p.y);
+}
+
+Box emptyBox()
+{
+  double inf = std::numeric_limits<double>::infinity();
+  Box box = {inf, inf, -inf, -inf};
+  return box;
+}
+
+bool boxIsEmpty(Box box)
+{
+  return box.x0 > box.x1 || box.y0 > box.y1;
+}
+
+void boxAddPoint(Box *box, Point p)
+{
+  box->x0 = fmin(box->x0, p.x);
+  box->y0 = fmin(box->y0, p.y);
+  box->x1 = fmax(box->x1, p.x);
+  box->y1 = fmax(box->y1, p.y);
+}
+
+Box boxUnion(Box a, Box b)
+{
+  if (boxIsEmpty(a))
+    return b;
+  if (boxIsEmpty(b))
+    return a;
+  Box box = {fmin(a.x0, b.x0), fmin(a.y0, b.y0), fmax(a.x1, b.x1), fmax(a.y1, b.y1)};
+  return box;
+}
+
+Box boxIntersect(Box a, Box b)
+{
+  Box box = {fmax(a.x0, b.x0), fmax(a.y0, b.y0), fmin(a.x1, b.x1), fmin(a.y1, b.y1)};
+  if (boxIsEmpty(box))
+    return emptyBox();
+  return box;
+}
+
+Box transformBox(Matrix m, Box box)
+{
+  if (boxIsEmpty(box))
+    return box;
+  Box out = emptyBox();
+  Point corners[4] = {{box.x0, box.y0}, {box.x1, box.y0}, {box.x1, box.y1}, {box.x0, box.y1}};
+  for (int i = 0; i < 4; i++)
+    boxAddPoint(&out, transformPoint(m, corners[i]));
+  return out;
+}
+
+Point segmentPoint(const Segment *segment, double t)
+{
+  Point p;
+  if (segment->type == SEGMENT_LINE)
+  {
+    p.x = segment->p[0].x + t * (segment->p[3].x - segment->p[0].x);
+    p.y = segment->p[0].y + t * (segment->p[3].y - segment->p[0].y);
+  }
+  else if (segment->type == SEGMENT_CUBIC)
+  {
+    double mt = 1 - t;
+    double w0 = mt * mt * mt;
+    double w1 = 3 * mt * mt * t;
+    double w2 = 3 * mt * t * t;
+    double w3 = t * t * t;
+    p.x = w0 * segment->p[0].x + w1 * segment->p[1].x + w2 * segment->p[2].x + w3 * segment->p[3].x;
+    p.y = w0 * segment->p[0].y + w1 * segment->p[1].y + w2 * segment->p[2].y + w3 * segment->p[3].y;
+  }
+  else
+  {
+    double angle = segment->start_angle + t * segment->sweep;
+    p.x = segment->center.x + segment->radii.x * cos(angle);
+    p.y = segment->center.y + segment->radii.y * sin(angle);
+  }
+  return p;
+}
+
+Point segmentDerivative(const Segment *segment, double t)
+{
+  Point d;
+  if (segment->type == SEGMENT_LINE)
+  {
+    d.x = segment->p[3].x - segment->p[0].x;
+    d.y = segment->p[3].y - segment->p[0].y;
+  }
+  else if (segment->type == SEGMENT_CUBIC)
+  {
+    double mt = 1 - t;
+    double w0 = 3 * mt * mt;
+    double w1 = 6 * mt * t;
+    double w2 = 3 * t * t;
+    d.x = w0 * (segment->p[1].x - segment->p[0].x) + w1 * (segment->p[2].x - segment->p[1].x) + w2 * (segment->p[3].x - segment->p[2].x);
+    d.y = w0 * (segment->p[1].y - segment->p[0].y) + w1 * (segment->p[2].y - segment->p[1].y) + w2 * (segment->p[3].y - segment->p[2].y);
+  }
+  else
+  {
+    double angle = segment->start_angle + t * segment->sweep;
+    d.x = -segment->radii.x * sin(angle) * segment->sweep;
+    d.y = segment->radii.y * cos(angle) * segment->sweep;
+  }
+  return d;
+}
+
+static int addRoot(double t, double *ts, int count)
+{
+  if (t > 0 && t < 1)
+    ts[count++] = t;
+  return count;
+}
+
+int segmentCriticalPoints(const Segment *segment, Point u, double *ts)
+{
+  int count = 0;
+  if (segment->type == SEGMENT_CUBIC)
+  {
+    /* dot(u, P'(t)) / 3 is a quadratic in Bernstein form over A, B, C. */
+    Point d0 = {segment->p[1].x - segment->p[0].x, segment->p[1].y - segment->p[0].y};
+    Point d1 = {segment->p[2].x - segment->p[1].x, segment->p[2].y - segment->p[1].y};
+    Point d2 = {segment->p[3].x - segment->p[2].x, segment->p[3].y - segment->p[2].y};
+    double A = dot(u, d0);
+    double B = dot(u, d1);
+    double C = dot(u, d2);
+    double a = A - 2 * B + C;
+    double b = 2 * (B - A);
+    double c = A;
+    double scale = fabs(A) + fabs(B) + fabs(C);
+    if (scale == 0)
+      return 0;
+    if (fabs(a) <= 1e-12 * scale)
+    {
+      if (fabs(b) > 1e-12 * scale)
+        count = addRoot(-c / b, ts, count);
+      return count;
+    }
+    double disc = b * b - 4 * a * c;
+    if (disc < 0)
+      return 0;
+    /* Numerically stable form of the quadratic formula. */
+    double q = -0.5 * (b + copysign(sqrt(disc), b));
+    count = addRoot(q / a, ts, count);
+    if (q != 0)
+      count = addRoot(c / q, ts, count);
+  }
+  else if (segment->type == SEGMENT_ARC && segment->sweep != 0)
+  {
+    /* dot(u, P'(angle)) = -ux*rx*sin(angle) + uy*ry*cos(angle) vanishes at
+     * angle = atan2(uy*ry, ux*rx) + k*pi. */
+    double base = atan2(u.y * segment->radii.y, u.x * segment->radii.x);
+    double lo = fmin(segment->start_angle, segment->start_angle + segment->sweep);
+    double hi = fmax(segment->start_angle, segment->start_angle + segment->sweep);
+    double k = ceil((lo - base) / M_PI);
+    for (double angle = base + k * M_PI; angle < hi && count < 4; angle += M_PI)
+      count = addRoot((angle - segment->start_angle) / segment->sweep, ts, count);
+  }
+  return count;
+}
+
+double fillSupport(const PathGeometry *path, Point u)
+{
+  double support = -std::numeric_limits<double>::infinity();
+  double ts[4];
+  for (auto const& subpath: path->subpaths)
+  {
+    for (auto const& segment: subpath.segments)
+    {
+      support = fmax(support, dot(u, segment.p[0]));
+      support = fmax(support, dot(u, segment.p[3]));
+      int count = segmentCriticalPoints(&segment, u, ts);
+      for (int i = 0; i < count; i++)
+        support = fmax(support, dot(u, segmentPoint(&segment, ts[i])));
+    }
+  }
+  return support;
+}
+
+bool pathHasSegments(const PathGeometry *path)
+{
+  for (auto const& subpath: path->subpaths)
+  {
+    if (!subpath.segments.empty())
+      return true;
+  }
+  return false;
+}
+
+Box transformedFillBounds(const PathGeometry *path, Matrix m)
+{
+  if (!pathHasSegments(path))
+    return emptyBox();
+  return boundsFromSupport(m, [path](Point u) { return fillSupport(path, u); });
+}
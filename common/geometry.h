@@ -0,0 +1,109 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <vector>
+
+/* Plain geometry used by the analytic bounding box engine. Nothing in here
+ * knows about pixels or paint. */
+
+typedef struct _Point {
+  double x;
+  double y;
+} Point;
+
+/* Same layout as an SVG matrix(a b c d tx ty): x' = a*x + c*y + tx and
+ * y' = b*x + d*y + ty. */
+typedef struct _Matrix {
+  double a;
+  double b;
+  double c;
+  double d;
+  double tx;
+  double ty;
+} Matrix;
+
+/* Axis aligned box, empty while x0 > x1. */
+typedef struct _Box {
+  double x0;
+  double y0;
+  double x1;
+  double y1;
+} Box;
+
+typedef enum _SegmentType {
+  SEGMENT_LINE = 0,
+  SEGMENT_CUBIC = 1,
+  SEGMENT_ARC = 2
+} SegmentType;
+
+/* p[0] is always the start point and p[3] the end point. Cubics use p[1] and
+ * p[2] as control points. Arcs are pieces of an axis aligned ellipse, which is
+ * all Path::Ellipse and Path::RoundedRect can produce. */
+typedef struct _Segment {
+  SegmentType type;
+  Point p[4];
+  Point center;
+  Point radii;
+  double start_angle;
+  double sweep;
+} Segment;
+
+typedef struct _Subpath {
+  Point start;
+  std::vector<Segment> segments;
+  bool closed;
+  /* The way the caps face when the subpath has no length: the x axis, or
+   * along the path for a zero length dash. */
+  Point direction = {1, 0};
+} Subpath;
+
+typedef struct _PathGeometry {
+  std::vector<Subpath> subpaths;
+} PathGeometry;
+
+Matrix identityMatrix();
+Matrix matrixMultiply(Matrix outer, Matrix inner);
+/* Largest factor the linear part of m stretches any vector by. */
+double matrixScale(Matrix m);
+Point transformPoint(Matrix m, Point p);
+double dot(Point a, Point b);
+double length(Point p);
+
+Box emptyBox();
+bool boxIsEmpty(Box box);
+void boxAddPoint(Box *box, Point p);
+Box boxUnion(Box a, Box b);
+Box boxIntersect(Box a, Box b);
+Box transformBox(Matrix m, Box box);
+
+Point segmentPoint(const Segment *segment, double t);
+Point segmentDerivative(const Segment *segment, double t);
+/* Parameters in (0, 1) where the segment's tangent is perpendicular to u,
+ * i.e. where dot(u, P(t)) has a local extremum. Returns how many were found. */
+int segmentCriticalPoints(const Segment *segment, Point u, double *ts);
+
+/* Support function of the filled path: the largest dot(u, p) over all points
+ * p of the outline. The bounds of the path under any affine matrix follow
+ * from four of these, so curves are never flattened. */
+bool pathHasSegments(const PathGeometry *path);
+double fillSupport(const PathGeometry *path, Point u);
+Box transformedFillBounds(const PathGeometry *path, Matrix m);
+
+/* Converts support functions in local space into an axis aligned box in the
+ * space m maps to. */
+template<typename Support>
+Box boundsFromSupport(Matrix m, Support support)
+{
+  Point ux = {m.a, m.c};
+  Point uy = {m.b, m.d};
+  Point nux = {-m.a, -m.c};
+  Point nuy = {-m.b, -m.d};
+  Box box;
+  box.x1 = support(ux) + m.tx;
+  box.x0 = -support(nux) + m.tx;
+  box.y1 = support(uy) + m.ty;
+  box.y0 = -support(nuy) + m.ty;
+  return box;
+}
+
+#endif
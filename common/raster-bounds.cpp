@@ -0,0 +1,247 @@
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RASTER_BOUNDS_X86 1
+#endif
+
+#include "raster-bounds.h"
+
+#define ALPHA_MASK 0xff000000u
+/* Largest side, in pixels, of the coarse pass and of any full scale band. */
+#define COARSE_SIZE 512
+/* Cairo's limit on the side of an image surface. */
+#define MAX_BAND_SIZE 32767
+
+/* Each kernel returns the index of the first (or last) pixel with ink in
+ * row[from, to), or -1. */
+typedef int (*InkKernel)(const uint32_t *row, int from, int to);
+
+static int firstInkScalar(const uint32_t *row, int from, int to)
+{
+  for (int x = from; x < to; x++)
+    if (row[x] & ALPHA_MASK)
+      return x;
+  return -1;
+}
+
+static int lastInkScalar(const uint32_t *row, int from, int to)
+{
+  for (int x = to - 1; x >= from; x--)
+    if (row[x] & ALPHA_MASK)
+      return x;
+  return -1;
+}
+
+#ifdef RASTER_BOUNDS_X86
+/* 32 bytes (8 pixels) per step; the block is only looked at pixel by pixel
+ * once it is known to hold ink. */
+static int firstInkSSE2(const uint32_t *row, int from, int to)
+{
+  const __m128i mask = _mm_set1_epi32((int)ALPHA_MASK);
+  int x = from;
+  for (; x + 8 <= to; x += 8)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(row + x));
+    __m128i b = _mm_loadu_si128((const __m128i*)(row + x + 4));
+    __m128i alpha = _mm_and_si128(_mm_or_si128(a, b), mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) != 0xffff)
+      return firstInkScalar(row, x, x + 8);
+  }
+  return firstInkScalar(row, x, to);
+}
+
+static int lastInkSSE2(const uint32_t *row, int from, int to)
+{
+  const __m128i mask = _mm_set1_epi32((int)ALPHA_MASK);
+  int x = to;
+  for (; x - 8 >= from; x -= 8)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(row + x - 8));
+    __m128i b = _mm_loadu_si128((const __m128i*)(row + x - 4));
+    __m128i alpha = _mm_and_si128(_mm_or_si128(a, b), mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) != 0xffff)
+      return lastInkScalar(row, x - 8, x);
+  }
+  return lastInkScalar(row, from, x);
+}
+
+/* 64 bytes (16 pixels) per step. */
+__attribute__((target("avx2")))
+static int firstInkAVX2(const uint32_t *row, int from, int to)
+{
+  const __m256i mask = _mm256_set1_epi32((int)ALPHA_MASK);
+  int x = from;
+  for (; x + 16 <= to; x += 16)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(row + x));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(row + x + 8));
+    if (!_mm256_testz_si256(_mm256_or_si256(a, b), mask))
+      return firstInkScalar(row, x, x + 16);
+  }
+  return firstInkScalar(row, x, to);
+}
+
+__attribute__((target("avx2")))
+static int lastInkAVX2(const uint32_t *row, int from, int to)
+{
+  const __m256i mask = _mm256_set1_epi32((int)ALPHA_MASK);
+  int x = to;
+  for (; x - 16 >= from; x -= 16)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(row + x - 16));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(row + x - 8));
+    if (!_mm256_testz_si256(_mm256_or_si256(a, b), mask))
+      return lastInkScalar(row, x - 16, x);
+  }
+  return lastInkScalar(row, from, x);
+}
+#endif
+
+typedef struct _InkKernels {
+  InkKernel first;
+  InkKernel last;
+} InkKernels;
+
+static InkKernels selectKernels()
+{
+  InkKernels kernels = {firstInkScalar, lastInkScalar};
+#ifdef RASTER_BOUNDS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    kernels.first = firstInkAVX2;
+    kernels.last = lastInkAVX2;
+  }
+  else if (__builtin_cpu_supports("sse2"))
+  {
+    kernels.first = firstInkSSE2;
+    kernels.last = lastInkSSE2;
+  }
+#endif
+  return kernels;
+}
+
+bool scanInkBounds(const uint32_t *pixels, int width, int height, int stride, int *x0, int *y0, int *x1, int *y1)
+{
+  static const InkKernels kernels = selectKernels();
+
+  int left = width, right = -1, top = -1, bottom = -1;
+  for (int y = 0; y < height; y++)
+  {
+    const uint32_t *row = pixels + (size_t)y * stride;
+    /* Only the part of the row outside [left, right] can move an edge, but
+     * the row still has to be checked for ink to move top and bottom. */
+    int first = kernels.first(row, 0, std::min(left, width));
+    if (first < 0)
+    {
+      if (right < 0)
+        continue;
+      first = kernels.first(row, left, right + 1);
+      if (first < 0)
+        first = kernels.first(row, right + 1, width);
+      if (first < 0)
+        continue;
+    }
+    if (top < 0)
+      top = y;
+    bottom = y;
+    left = std::min(left, first);
+    int last = kernels.last(row, std::max(first, right + 1), width);
+    right = std::max(right, last >= 0 ? last : first);
+  }
+
+  if (top < 0)
+    return false;
+  *x0 = left;
+  *y0 = top;
+  *x1 = right;
+  *y1 = bottom;
+  return true;
+}
+
+/* Renders [ux0, ux1] x [uy0, uy1] of the recording at `scale` and sets
+ * `found` and the ink bounds in pixels of that band. Returns 1 if the image
+ * surface couldn't be created. */
+static int renderBand(cairo_surface_t *recording, double ux0, double uy0, double ux1, double uy1, double scale,
+                      bool *found, int *x0, int *y0, int *x1, int *y1)
+{
+  int width = std::max(1, (int)ceil((ux1 - ux0) * scale));
+  int height = std::max(1, (int)ceil((uy1 - uy0) * scale));
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+  {
+    cairo_surface_destroy(surface);
+    return 1;
+  }
+
+  /* New image surfaces are cleared to transparent. */
+  cairo_t *cr = cairo_create(surface);
+  cairo_scale(cr, scale, scale);
+  cairo_translate(cr, -ux0, -uy0);
+  cairo_set_source_surface(cr, recording, 0, 0);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(surface);
+
+  *found = scanInkBounds((const uint32_t*)cairo_image_surface_get_data(surface), width, height,
+                         cairo_image_surface_get_stride(surface) / 4, x0, y0, x1, y1);
+  cairo_surface_destroy(surface);
+  return 0;
+}
+
+int rasterInkBounds(cairo_surface_t *recording, Box region, double scale, Box *ink)
+{
+  *ink = emptyBox();
+  if (boxIsEmpty(region))
+    return 0;
+  double region_width = region.x1 - region.x0, region_height = region.y1 - region.y0;
+  double longest = std::max(region_width, region_height);
+  /* A band runs along the coarse box, up to COARSE_SIZE + 1 pixels once
+   * rounded up, plus a coarse pixel of margin at each end. All of it has to
+   * fit in MAX_BAND_SIZE, less one for rounding the band up to pixels. */
+  double band_length = std::max(longest, 1e-9) * (COARSE_SIZE + 3) / COARSE_SIZE;
+  scale = std::min(scale, (MAX_BAND_SIZE - 1) / band_length);
+  double coarse = std::min(scale, COARSE_SIZE / std::max(longest, 1e-9));
+
+  bool found;
+  int cx0, cy0, cx1, cy1;
+  if (renderBand(recording, region.x0, region.y0, region.x1, region.y1, coarse, &found, &cx0, &cy0, &cx1, &cy1))
+    return 1;
+  if (!found)
+    return 0;
+
+  /* The true edge is inside the outermost coarse pixel with ink, or in the
+   * one next to it when antialiasing rounded a sliver of coverage to zero.
+   * Each band spans those two pixels across and the whole coarse box along.
+   * A band with no ink at full scale keeps the coarse edge, which still
+   * bounds the ink. */
+  double pixel = 1 / coarse;
+  Box outer = {region.x0 + (cx0 - 1) * pixel, region.y0 + (cy0 - 1) * pixel,
+               region.x0 + (cx1 + 2) * pixel, region.y0 + (cy1 + 2) * pixel};
+  Box inner = {region.x0 + (cx0 + 1) * pixel, region.y0 + (cy0 + 1) * pixel,
+               region.x0 + cx1 * pixel, region.y0 + cy1 * pixel};
+  *ink = {region.x0 + cx0 * pixel, region.y0 + cy0 * pixel, region.x0 + (cx1 + 1) * pixel, region.y0 + (cy1 + 1) * pixel};
+  if (coarse >= scale)
+    return 0;
+
+  int x0, y0, x1, y1;
+  if (renderBand(recording, outer.x0, outer.y0, inner.x0, outer.y1, scale, &found, &x0, &y0, &x1, &y1))
+    return 1;
+  if (found)
+    ink->x0 = outer.x0 + x0 / scale;
+  if (renderBand(recording, inner.x1, outer.y0, outer.x1, outer.y1, scale, &found, &x0, &y0, &x1, &y1))
+    return 1;
+  if (found)
+    ink->x1 = inner.x1 + (x1 + 1) / scale;
+  if (renderBand(recording, outer.x0, outer.y0, outer.x1, inner.y0, scale, &found, &x0, &y0, &x1, &y1))
+    return 1;
+  if (found)
+    ink->y0 = outer.y0 + y0 / scale;
+  if (renderBand(recording, outer.x0, inner.y1, outer.x1, outer.y1, scale, &found, &x0, &y0, &x1, &y1))
+    return 1;
+  if (found)
+    ink->y1 = inner.y1 + (y1 + 1) / scale;
+  return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef RASTER_BOUNDS_H
+#define RASTER_BOUNDS_H
+
+#include <cstdint>
+
+#include <cairo.h>
+
+#include "geometry.h"
+
+/* Ground truth for the other engines: the pixels a document really touches.
+ * Pixels are premultiplied ARGB32, so a pixel has ink iff its alpha is not
+ * zero. */
+
+/* Smallest pixel rectangle [x0, x1] x [y0, y1] (inclusive) holding every
+ * pixel with non-zero alpha. stride is in pixels. Returns false if the image
+ * is fully transparent. Uses AVX2 or SSE2 when the CPU has them. */
+bool scanInkBounds(const uint32_t *pixels, int width, int height, int stride, int *x0, int *y0, int *x1, int *y1);
+
+/* Rasterizes `recording` (a cairo recording surface) over `region` at
+ * `scale` pixels per unit and sets `ink` to the ink bounds in recording
+ * units, empty if nothing has ink. Works coarse to fine: the whole region is
+ * rendered small first, then only the four bands around the coarse edges are
+ * rendered at full scale. The scale is lowered so that no band is larger
+ * than Cairo allows. Returns 1 if a surface couldn't be created. */
+int rasterInkBounds(cairo_surface_t *recording, Box region, double scale, Box *ink);
+
+#endif
@@ -0,0 +1,87 @@
+#include <cmath>
+
+#include "simplify.h"
+#include "clip-bounds.h"
+
+/* Distance from p to the segment [a, b]. */
+static double segmentDistance(Point p, Point a, Point b)
+{
+  Point ab = {b.x - a.x, b.y - a.y};
+  Point ap = {p.x - a.x, p.y - a.y};
+  double squared = dot(ab, ab);
+  double t = squared > 0 ? fmin(1, fmax(0, dot(ap, ab) / squared)) : 0;
+  Point closest = {a.x + t * ab.x - p.x, a.y + t * ab.y - p.y};
+  return length(closest);
+}
+
+void simplifyPolyline(std::vector<Point> const& points, double tolerance, std::vector<Point> *simplified)
+{
+  simplified->clear();
+  size_t count = points.size();
+  if (count <= 2)
+  {
+    *simplified = points;
+    return;
+  }
+  std::vector<bool> keep(count, false);
+  keep[0] = keep[count - 1] = true;
+  /* Ranges still to split, without recursion so long polylines can't blow
+   * the stack. */
+  std::vector<std::pair<size_t, size_t>> ranges;
+  ranges.push_back({0, count - 1});
+  while (!ranges.empty())
+  {
+    size_t first = ranges.back().first;
+    size_t last = ranges.back().second;
+    ranges.pop_back();
+    double farthest = -1;
+    size_t split = first;
+    for (size_t i = first + 1; i < last; i++)
+    {
+      double distance = segmentDistance(points[i], points[first], points[last]);
+      if (distance > farthest)
+      {
+        farthest = distance;
+        split = i;
+      }
+    }
+    if (farthest <= tolerance)
+      continue;
+    keep[split] = true;
+    ranges.push_back({first, split});
+    ranges.push_back({split, last});
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    if (keep[i])
+      simplified->push_back(points[i]);
+  }
+}
+
+void simplifyPath(const PathGeometry *path, double tolerance, PathGeometry *simplified)
+{
+  simplified->subpaths.clear();
+  Polygon flat;
+  flattenPath(path, identityMatrix(), tolerance / 2, false, &flat);
+  /* flattenPath skips empty subpaths, so walk both in step. */
+  size_t contour = 0;
+  std::vector<Point> points;
+  for (auto const& subpath: path->subpaths)
+  {
+    if (subpath.segments.empty())
+      continue;
+    simplifyPolyline(flat.contours[contour++], tolerance / 2, &points);
+    Subpath out;
+    out.start = points.front();
+    out.closed = subpath.closed;
+    for (size_t i = 1; i < points.size(); i++)
+    {
+      Segment segment;
+      segment.type = SEGMENT_LINE;
+      segment.p[0] = segment.p[1] = points[i - 1];
+      segment.p[2] = segment.p[3] = points[i];
+      out.segments.push_back(segment);
+    }
+    simplified->subpaths.push_back(out);
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+
+#include "geometry.h"
+
+/* Level of detail geometry for paths seen from far away. */
+
+/* Douglas-Peucker: the subset of `points` that keeps every dropped point
+ * within `tolerance` of the kept polyline. The first and last points are
+ * always kept. */
+void simplifyPolyline(std::vector<Point> const& points, double tolerance, std::vector<Point> *simplified);
+
+/* Flattens every subpath and simplifies it, each within half of `tolerance`,
+ * so the resulting line segments stay within `tolerance` of `path` in local
+ * units. Subpaths keep their closed flag, so strokes stay open. */
+void simplifyPath(const PathGeometry *path, double tolerance, PathGeometry *simplified);
+
+#endif
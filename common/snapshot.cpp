@@ -0,0 +1,248 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+static std::string snapshot_directory;
+
+int snapshotVerbCoords(SnapshotVerb verb)
+{
+  static const int coords[SNAPSHOT_VERB_COUNT] = {4, 6, 4, 2, 2, 6, 4, 0};
+  return verb < SNAPSHOT_VERB_COUNT ? coords[verb] : -1;
+}
+
+void snapshotInitialize(const char *directory)
+{
+  snapshot_directory = directory ? directory : "";
+}
+
+bool snapshotsEnabled()
+{
+  return !snapshot_directory.empty();
+}
+
+std::string snapshotSourcePath(std::string svg_filename)
+{
+  char *resolved = realpath(svg_filename.c_str(), NULL);
+  if (!resolved)
+    return "";
+  std::string path = resolved;
+  free(resolved);
+  return path;
+}
+
+/* Named after an FNV-1a hash of the canonical path, so snapshots of a corpus
+ * can live in one flat directory. The path itself is stored in the snapshot
+ * too, in case two of them hash alike. */
+std::string snapshotFilename(std::string source_path)
+{
+  if (snapshot_directory.empty())
+    return "";
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c: source_path)
+    hash = (hash ^ c) * 1099511628211ull;
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.svgsnap", (unsigned long long)hash);
+  return snapshot_directory + "/" + name;
+}
+
+void clearSnapshot(SVGSnapshot *snapshot)
+{
+  memset(snapshot, 0, sizeof(*snapshot));
+}
+
+/* Points `data` at the records of section `id`, checking that they lie
+ * within the mapping and are aligned for `size` byte records. */
+static bool mapSection(SVGSnapshot *snapshot, int id, size_t size, const void **data, size_t *count)
+{
+  const SnapshotSection *section = &snapshot->header->sections[id];
+  if (section->offset % 8 != 0 || section->offset > snapshot->mapping_size)
+    return false;
+  if (section->count > (snapshot->mapping_size - section->offset) / size)
+    return false;
+  *data = (const char*)snapshot->mapping + section->offset;
+  *count = section->count;
+  return true;
+}
+
+#define MAP_SECTION(id, field, count) \
+  mapSection(snapshot, id, sizeof(*snapshot->field), (const void**)&snapshot->field, &(count))
+
+int openSnapshot(std::string filename, SVGSnapshot *snapshot)
+{
+  clearSnapshot(snapshot);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return 1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader))
+  {
+    close(fd);
+    return 1;
+  }
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return 1;
+  snapshot->mapping = mapping;
+  snapshot->mapping_size = st.st_size;
+  snapshot->header = (const SnapshotHeader*)mapping;
+
+  const SnapshotHeader *header = snapshot->header;
+  bool ok = header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION &&
+            header->section_count == SNAPSHOT_SECTION_COUNT && header->file_size == snapshot->mapping_size;
+  size_t path_starts = 0, coord_starts = 0, transform_floats = 0, stop_floats = 0, rect_floats = 0;
+  ok = ok && MAP_SECTION(SNAPSHOT_OPS, ops, snapshot->op_count) &&
+       MAP_SECTION(SNAPSHOT_OP_ARGS, op_args, snapshot->op_count) &&
+       MAP_SECTION(SNAPSHOT_PATH_VERB_START, path_verb_start, path_starts) &&
+       MAP_SECTION(SNAPSHOT_PATH_COORD_START, path_coord_start, coord_starts) &&
+       MAP_SECTION(SNAPSHOT_VERBS, verbs, snapshot->verb_count) &&
+       MAP_SECTION(SNAPSHOT_COORDS, coords, snapshot->coord_count) &&
+       MAP_SECTION(SNAPSHOT_TRANSFORMS, transforms, transform_floats) &&
+       MAP_SECTION(SNAPSHOT_STYLES, styles, snapshot->style_count) &&
+       MAP_SECTION(SNAPSHOT_CLIPS, clips, snapshot->clip_count) &&
+       MAP_SECTION(SNAPSHOT_FILLS, fills, snapshot->fill_count) &&
+       MAP_SECTION(SNAPSHOT_STROKES, strokes, snapshot->stroke_count) &&
+       MAP_SECTION(SNAPSHOT_DASHES, dashes, snapshot->dash_count) &&
+       MAP_SECTION(SNAPSHOT_PAINTS, paints, snapshot->paint_count) &&
+       MAP_SECTION(SNAPSHOT_STOPS, stops, stop_floats) &&
+       MAP_SECTION(SNAPSHOT_RECTS, rects, rect_floats) &&
+       MAP_SECTION(SNAPSHOT_IMAGES, images, snapshot->image_count) &&
+       MAP_SECTION(SNAPSHOT_BYTES, bytes, snapshot->byte_count) &&
+       MAP_SECTION(SNAPSHOT_SOURCE_PATH, source_path, snapshot->source_path_size);
+  /* Both op sections map to op_count, so check they really agree. */
+  ok = ok && header->sections[SNAPSHOT_OPS].count == header->sections[SNAPSHOT_OP_ARGS].count &&
+       path_starts > 0 && path_starts == coord_starts &&
+       transform_floats % 6 == 0 && stop_floats % 5 == 0 && rect_floats % 4 == 0;
+  if (!ok)
+  {
+    closeSnapshot(snapshot);
+    return 1;
+  }
+  snapshot->path_count = path_starts - 1;
+  snapshot->transform_count = transform_floats / 6;
+  snapshot->stop_count = stop_floats / 5;
+  snapshot->rect_count = rect_floats / 4;
+  return 0;
+}
+
+void closeSnapshot(SVGSnapshot *snapshot)
+{
+  if (snapshot->mapping)
+    munmap(snapshot->mapping, snapshot->mapping_size);
+  clearSnapshot(snapshot);
+}
+
+bool snapshotIsFresh(const SVGSnapshot *snapshot, const SnapshotSource *source)
+{
+  if (!snapshot->header)
+    return false;
+  return snapshot->header->source_size == source->size &&
+         snapshot->header->source_mtime_sec == source->mtime_sec &&
+         snapshot->header->source_mtime_nsec == source->mtime_nsec &&
+         snapshot->source_path_size == source->path.size() &&
+         memcmp(snapshot->source_path, source->path.data(), source->path.size()) == 0;
+}
+
+static bool writeAll(FILE *file, const void *data, size_t size)
+{
+  return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+template <typename T>
+static void addSection(SnapshotHeader *header, int id, std::vector<T> const& records, uint64_t *offset)
+{
+  header->sections[id].offset = *offset;
+  header->sections[id].count = records.size();
+  *offset += (records.size() * sizeof(T) + 7) & ~(uint64_t)7;
+}
+
+int writeSnapshot(std::string filename, const SnapshotSource *source, const SnapshotData *data)
+{
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.section_count = SNAPSHOT_SECTION_COUNT;
+  header.source_size = source->size;
+  header.source_mtime_sec = source->mtime_sec;
+  header.source_mtime_nsec = source->mtime_nsec;
+
+  uint64_t offset = (sizeof(header) + 7) & ~(uint64_t)7;
+  addSection(&header, SNAPSHOT_OPS, data->ops, &offset);
+  addSection(&header, SNAPSHOT_OP_ARGS, data->op_args, &offset);
+  addSection(&header, SNAPSHOT_PATH_VERB_START, data->path_verb_start, &offset);
+  addSection(&header, SNAPSHOT_PATH_COORD_START, data->path_coord_start, &offset);
+  addSection(&header, SNAPSHOT_VERBS, data->verbs, &offset);
+  addSection(&header, SNAPSHOT_COORDS, data->coords, &offset);
+  addSection(&header, SNAPSHOT_TRANSFORMS, data->transforms, &offset);
+  addSection(&header, SNAPSHOT_STYLES, data->styles, &offset);
+  addSection(&header, SNAPSHOT_CLIPS, data->clips, &offset);
+  addSection(&header, SNAPSHOT_FILLS, data->fills, &offset);
+  addSection(&header, SNAPSHOT_STROKES, data->strokes, &offset);
+  addSection(&header, SNAPSHOT_DASHES, data->dashes, &offset);
+  addSection(&header, SNAPSHOT_PAINTS, data->paints, &offset);
+  addSection(&header, SNAPSHOT_STOPS, data->stops, &offset);
+  addSection(&header, SNAPSHOT_RECTS, data->rects, &offset);
+  addSection(&header, SNAPSHOT_IMAGES, data->images, &offset);
+  addSection(&header, SNAPSHOT_BYTES, data->bytes, &offset);
+  std::vector<char> source_path(source->path.begin(), source->path.end());
+  addSection(&header, SNAPSHOT_SOURCE_PATH, source_path, &offset);
+  header.file_size = offset;
+
+  /* Unique per process and thread, since workers may snapshot files in
+   * parallel. */
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), ".%d.%zx.tmp", (int)getpid(), std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::string temporary = filename + suffix;
+  FILE *file = fopen(temporary.c_str(), "wb");
+  if (!file)
+    return 1;
+
+  static const char zeros[8] = {0};
+  uint64_t written = sizeof(header);
+  bool ok = writeAll(file, &header, sizeof(header));
+  auto pad = [&]() {
+    size_t padding = (8 - written % 8) % 8;
+    written += padding;
+    return writeAll(file, zeros, padding);
+  };
+  auto section = [&](const void *records, size_t size) {
+    written += size;
+    return writeAll(file, records, size) && pad();
+  };
+  ok = ok && pad() &&
+       section(data->ops.data(), data->ops.size()) &&
+       section(data->op_args.data(), data->op_args.size() * sizeof(SnapshotOpArgs)) &&
+       section(data->path_verb_start.data(), data->path_verb_start.size() * sizeof(uint32_t)) &&
+       section(data->path_coord_start.data(), data->path_coord_start.size() * sizeof(uint32_t)) &&
+       section(data->verbs.data(), data->verbs.size()) &&
+       section(data->coords.data(), data->coords.size() * sizeof(float)) &&
+       section(data->transforms.data(), data->transforms.size() * sizeof(float)) &&
+       section(data->styles.data(), data->styles.size() * sizeof(SnapshotStyle)) &&
+       section(data->clips.data(), data->clips.size() * sizeof(SnapshotClip)) &&
+       section(data->fills.data(), data->fills.size() * sizeof(SnapshotFill)) &&
+       section(data->strokes.data(), data->strokes.size() * sizeof(SnapshotStroke)) &&
+       section(data->dashes.data(), data->dashes.size() * sizeof(float)) &&
+       section(data->paints.data(), data->paints.size() * sizeof(SnapshotPaint)) &&
+       section(data->stops.data(), data->stops.size() * sizeof(float)) &&
+       section(data->rects.data(), data->rects.size() * sizeof(float)) &&
+       section(data->images.data(), data->images.size() * sizeof(SnapshotImage)) &&
+       section(data->bytes.data(), data->bytes.size()) &&
+       section(source_path.data(), source_path.size());
+  ok = fclose(file) == 0 && ok && written == header.file_size;
+  if (!ok || rename(temporary.c_str(), filename.c_str()) != 0)
+  {
+    unlink(temporary.c_str());
+    return 1;
+  }
+  return 0;
+}
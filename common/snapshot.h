@@ -0,0 +1,258 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Binary snapshots of parsed documents. A snapshot is the sequence of
+ * renderer calls SVGDocument::Render() makes for a file: every <use> and
+ * style already resolved, transforms as matrices and paths as flat verb and
+ * coordinate arrays. It is memory mapped and used in place, so opening one
+ * costs a mmap and a header check, and replaying it into any port skips XML
+ * parsing altogether (see SnapshotSVGRenderer.h).
+ *
+ * The file is a header followed by SNAPSHOT_SECTION_COUNT arrays of fixed
+ * size records, each 8 byte aligned. Indices between sections are 32 bit,
+ * with -1 for none. Snapshots are native endian and only meant to be read on
+ * the machine that wrote them. */
+
+#define SNAPSHOT_MAGIC 0x31504e5347565300ull /* "\0SVGSNP1" */
+#define SNAPSHOT_VERSION 2
+
+typedef enum _SnapshotOp {
+  SNAPSHOT_SAVE = 0,
+  SNAPSHOT_RESTORE = 1,
+  SNAPSHOT_DRAW_PATH = 2,
+  SNAPSHOT_DRAW_IMAGE = 3
+} SnapshotOp;
+
+/* Path verbs, in the order of the SVGNative::Path methods. The number of
+ * coordinates each one takes is snapshotVerbCoords(). */
+typedef enum _SnapshotVerb {
+  SNAPSHOT_RECT = 0,
+  SNAPSHOT_ROUNDED_RECT = 1,
+  SNAPSHOT_ELLIPSE = 2,
+  SNAPSHOT_MOVE_TO = 3,
+  SNAPSHOT_LINE_TO = 4,
+  SNAPSHOT_CURVE_TO = 5,
+  SNAPSHOT_CURVE_TO_V = 6,
+  SNAPSHOT_CLOSE_PATH = 7
+} SnapshotVerb;
+
+#define SNAPSHOT_VERB_COUNT 8
+
+typedef enum _SnapshotPaintKind {
+  SNAPSHOT_COLOR = 0,
+  SNAPSHOT_GRADIENT = 1
+} SnapshotPaintKind;
+
+/* One op. Save: a = style. Draw path: a = path, b = style, c = fill,
+ * d = stroke. Draw image: a = image, b = style, c = clip rect, d = fill
+ * rect. */
+typedef struct _SnapshotOpArgs {
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  uint32_t d;
+} SnapshotOpArgs;
+
+typedef struct _SnapshotStyle {
+  int32_t transform;
+  int32_t clip;
+  float opacity;
+  uint32_t blend_mode;
+} SnapshotStyle;
+
+typedef struct _SnapshotClip {
+  uint32_t path;
+  int32_t transform;
+  uint32_t clip_rule;
+  uint32_t has_clip_content;
+} SnapshotClip;
+
+typedef struct _SnapshotFill {
+  uint32_t paint;
+  float opacity;
+  uint32_t fill_rule;
+  uint32_t has_fill;
+} SnapshotFill;
+
+typedef struct _SnapshotStroke {
+  uint32_t paint;
+  float opacity;
+  float line_width;
+  float miter_limit;
+  float dash_offset;
+  uint32_t dash_start;
+  uint32_t dash_count;
+  uint8_t line_cap;
+  uint8_t line_join;
+  uint8_t has_stroke;
+  uint8_t pad;
+} SnapshotStroke;
+
+/* Gradient coordinates are x1 y1 x2 y2 cx cy fx fy r. Stops are offset and
+ * RGBA, five floats each. */
+typedef struct _SnapshotPaint {
+  uint8_t kind;
+  uint8_t gradient_type;
+  uint8_t spread_method;
+  uint8_t pad;
+  float color[4];
+  float coords[9];
+  int32_t transform;
+  uint32_t stop_start;
+  uint32_t stop_count;
+} SnapshotPaint;
+
+/* The base64 text of the image is data_size bytes at data_offset in the
+ * bytes section. */
+typedef struct _SnapshotImage {
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint32_t encoding;
+  uint32_t pad;
+} SnapshotImage;
+
+typedef enum _SnapshotSectionId {
+  SNAPSHOT_OPS = 0,           /* uint8_t SnapshotOp */
+  SNAPSHOT_OP_ARGS,           /* SnapshotOpArgs */
+  SNAPSHOT_PATH_VERB_START,   /* uint32_t, path count + 1 */
+  SNAPSHOT_PATH_COORD_START,  /* uint32_t, path count + 1 */
+  SNAPSHOT_VERBS,             /* uint8_t SnapshotVerb */
+  SNAPSHOT_COORDS,            /* float */
+  SNAPSHOT_TRANSFORMS,        /* float[6], a b c d tx ty */
+  SNAPSHOT_STYLES,            /* SnapshotStyle */
+  SNAPSHOT_CLIPS,             /* SnapshotClip */
+  SNAPSHOT_FILLS,             /* SnapshotFill */
+  SNAPSHOT_STROKES,           /* SnapshotStroke */
+  SNAPSHOT_DASHES,            /* float */
+  SNAPSHOT_PAINTS,            /* SnapshotPaint */
+  SNAPSHOT_STOPS,             /* float[5] */
+  SNAPSHOT_RECTS,             /* float[4], x y width height */
+  SNAPSHOT_IMAGES,            /* SnapshotImage */
+  SNAPSHOT_BYTES,             /* char */
+  SNAPSHOT_SOURCE_PATH,       /* char, canonical path of the source */
+  SNAPSHOT_SECTION_COUNT
+} SnapshotSectionId;
+
+typedef struct _SnapshotSection {
+  uint64_t offset;
+  uint64_t count;
+} SnapshotSection;
+
+/* What a snapshot is made from: the canonical path of the SVG file, and the
+ * size and modification time of the bytes that were actually read, taken
+ * from the open file rather than looked up by name again. A snapshot whose
+ * source no longer matches all three is stale. */
+typedef struct _SnapshotSource {
+  std::string path;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} SnapshotSource;
+
+/* The source path is kept in the SNAPSHOT_SOURCE_PATH section. */
+typedef struct _SnapshotHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t section_count;
+  uint64_t file_size;
+  uint64_t source_size;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+} SnapshotHeader;
+
+/* A snapshot being built, one vector per section. */
+typedef struct _SnapshotData {
+  std::vector<uint8_t> ops;
+  std::vector<SnapshotOpArgs> op_args;
+  std::vector<uint32_t> path_verb_start;
+  std::vector<uint32_t> path_coord_start;
+  std::vector<uint8_t> verbs;
+  std::vector<float> coords;
+  std::vector<float> transforms;
+  std::vector<SnapshotStyle> styles;
+  std::vector<SnapshotClip> clips;
+  std::vector<SnapshotFill> fills;
+  std::vector<SnapshotStroke> strokes;
+  std::vector<float> dashes;
+  std::vector<SnapshotPaint> paints;
+  std::vector<float> stops;
+  std::vector<float> rects;
+  std::vector<SnapshotImage> images;
+  std::vector<char> bytes;
+} SnapshotData;
+
+/* A mapped snapshot. Every pointer points into the mapping; counts are in
+ * records, so there are path_count + 1 entries in each start array. */
+typedef struct _SVGSnapshot {
+  void *mapping;
+  size_t mapping_size;
+  const SnapshotHeader *header;
+  size_t op_count;
+  const uint8_t *ops;
+  const SnapshotOpArgs *op_args;
+  size_t path_count;
+  const uint32_t *path_verb_start;
+  const uint32_t *path_coord_start;
+  size_t verb_count;
+  const uint8_t *verbs;
+  size_t coord_count;
+  const float *coords;
+  size_t transform_count;
+  const float *transforms;
+  size_t style_count;
+  const SnapshotStyle *styles;
+  size_t clip_count;
+  const SnapshotClip *clips;
+  size_t fill_count;
+  const SnapshotFill *fills;
+  size_t stroke_count;
+  const SnapshotStroke *strokes;
+  size_t dash_count;
+  const float *dashes;
+  size_t paint_count;
+  const SnapshotPaint *paints;
+  size_t stop_count;
+  const float *stops;
+  size_t rect_count;
+  const float *rects;
+  size_t image_count;
+  const SnapshotImage *images;
+  size_t byte_count;
+  const char *bytes;
+  size_t source_path_size;
+  const char *source_path;
+} SVGSnapshot;
+
+int snapshotVerbCoords(SnapshotVerb verb);
+
+/* Where snapshots are kept, usually getenv("SVG_SNAPSHOTS"). NULL or empty
+ * leaves snapshots off. */
+void snapshotInitialize(const char *directory);
+bool snapshotsEnabled();
+/* The canonical path of an SVG file, which is what snapshots are keyed on so
+ * that every spelling of the path finds the same one. "" if it doesn't
+ * resolve. */
+std::string snapshotSourcePath(std::string svg_filename);
+/* The snapshot file for a canonical source path, or "" when snapshots are
+ * off. */
+std::string snapshotFilename(std::string source_path);
+
+void clearSnapshot(SVGSnapshot *snapshot);
+/* Maps and checks the snapshot. Returns 0 on success and 1 if the file is
+ * missing, truncated or from another version; the section contents are
+ * checked when a document is created from it. */
+int openSnapshot(std::string filename, SVGSnapshot *snapshot);
+void closeSnapshot(SVGSnapshot *snapshot);
+/* Whether the snapshot was written for `source`. */
+bool snapshotIsFresh(const SVGSnapshot *snapshot, const SnapshotSource *source);
+/* Writes to a temporary file and renames it over `filename`, so readers
+ * never see a partial snapshot. Returns 0 on success. */
+int writeSnapshot(std::string filename, const SnapshotSource *source, const SnapshotData *data);
+
+#endif
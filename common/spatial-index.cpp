@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cmath>
+
+#include "spatial-index.h"
+
+static double centerX(IndexedElement const& element)
+{
+  return element.box.x0 + element.box.x1;
+}
+
+static double centerY(IndexedElement const& element)
+{
+  return element.box.y0 + element.box.y1;
+}
+
+static bool boxesOverlap(Box a, Box b)
+{
+  return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+static bool boxContains(Box box, Point p)
+{
+  return box.x0 <= p.x && p.x <= box.x1 && box.y0 <= p.y && p.y <= box.y1;
+}
+
+void clearSpatialIndex(SpatialIndex *index)
+{
+  index->elements.clear();
+  index->nodes.clear();
+  index->level_start.clear();
+}
+
+/* STR: sort by x, cut into sqrt(leaf count) vertical slices of whole leaves,
+ * sort each slice by y and fill leaves in that order. The levels above just
+ * group consecutive nodes, which are already close to each other. */
+void buildSpatialIndex(SpatialIndex *index, std::vector<Box> const& boxes, std::vector<int> const& parents)
+{
+  const size_t node_size = SPATIAL_INDEX_NODE_SIZE;
+  clearSpatialIndex(index);
+  index->elements.reserve(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++)
+  {
+    if (boxIsEmpty(boxes[i]))
+      continue;
+    IndexedElement element = {boxes[i], (uint32_t)i, i < parents.size() ? parents[i] : -1};
+    index->elements.push_back(element);
+  }
+  std::vector<IndexedElement>& elements = index->elements;
+  size_t count = elements.size();
+  if (count == 0)
+    return;
+
+  size_t leaves = (count + node_size - 1) / node_size;
+  size_t slices = (size_t)ceil(sqrt((double)leaves));
+  size_t slice_size = ((leaves + slices - 1) / slices) * node_size;
+  std::sort(elements.begin(), elements.end(),
+            [](IndexedElement const& a, IndexedElement const& b) { return centerX(a) < centerX(b); });
+  for (size_t start = 0; start < count; start += slice_size)
+  {
+    size_t end = std::min(count, start + slice_size);
+    std::sort(elements.begin() + start, elements.begin() + end,
+              [](IndexedElement const& a, IndexedElement const& b) { return centerY(a) < centerY(b); });
+  }
+
+  index->level_start.push_back(0);
+  for (size_t i = 0; i < count; i += node_size)
+  {
+    Box box = emptyBox();
+    for (size_t j = i; j < std::min(count, i + node_size); j++)
+      box = boxUnion(box, elements[j].box);
+    index->nodes.push_back(box);
+  }
+  while (index->nodes.size() - index->level_start.back() > 1)
+  {
+    size_t begin = index->level_start.back();
+    size_t end = index->nodes.size();
+    index->level_start.push_back(end);
+    for (size_t i = begin; i < end; i += node_size)
+    {
+      Box box = emptyBox();
+      for (size_t j = i; j < std::min(end, i + node_size); j++)
+        box = boxUnion(box, index->nodes[j]);
+      index->nodes.push_back(box);
+    }
+  }
+  index->level_start.push_back(index->nodes.size());
+}
+
+/* Depth first over the packed levels. `visit` is called for every leaf
+ * element whose box `overlaps` accepts. */
+template <typename Overlaps, typename Visit>
+static void searchSpatialIndex(const SpatialIndex *index, Overlaps overlaps, Visit visit)
+{
+  const size_t node_size = SPATIAL_INDEX_NODE_SIZE;
+  if (index->elements.empty())
+    return;
+  typedef struct _Pending {
+    int level;
+    size_t node;
+  } Pending;
+  /* The tree is at most a dozen levels deep, so this never gets large. */
+  Pending stack[16 * SPATIAL_INDEX_NODE_SIZE];
+  int depth = 0;
+  int root_level = (int)index->level_start.size() - 2;
+  stack[depth++] = {root_level, 0};
+  while (depth > 0)
+  {
+    Pending pending = stack[--depth];
+    size_t first = index->level_start[pending.level] + pending.node;
+    if (!overlaps(index->nodes[first]))
+      continue;
+    size_t child_begin = pending.node * node_size;
+    if (pending.level == 0)
+    {
+      size_t child_end = std::min(index->elements.size(), child_begin + node_size);
+      for (size_t i = child_begin; i < child_end; i++)
+      {
+        if (overlaps(index->elements[i].box))
+          visit(&index->elements[i]);
+      }
+      continue;
+    }
+    size_t level_size = index->level_start[pending.level] - index->level_start[pending.level - 1];
+    size_t child_end = std::min(level_size, child_begin + node_size);
+    for (size_t i = child_begin; i < child_end; i++)
+      stack[depth++] = {pending.level - 1, i};
+  }
+}
+
+void querySpatialIndex(const SpatialIndex *index, Box area, std::vector<const IndexedElement*> *hits)
+{
+  searchSpatialIndex(index,
+                     [area](Box box) { return boxesOverlap(box, area); },
+                     [hits](const IndexedElement *element) { hits->push_back(element); });
+}
+
+const IndexedElement *hitTestSpatialIndex(const SpatialIndex *index, Point p)
+{
+  const IndexedElement *top = NULL;
+  searchSpatialIndex(index,
+                     [p](Box box) { return boxContains(box, p); },
+                     [&top](const IndexedElement *element) {
+                       if (!top || element->order > top->order)
+                         top = element;
+                     });
+  return top;
+}
@@ -0,0 +1,47 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+/* A static R-tree over per-element boxes, bulk loaded with Sort-Tile-Recursive
+ * and packed level by level into flat arrays: no pointers, and the children
+ * of a node are SPATIAL_INDEX_NODE_SIZE consecutive boxes. Built once per
+ * document and then queried for as long as the document is shown. */
+
+#define SPATIAL_INDEX_NODE_SIZE 16
+
+/* An element is identified by its position in draw order, which is also its
+ * index in the box list the index was built from. parent is the group it
+ * was drawn in, or -1. */
+typedef struct _IndexedElement {
+  Box box;
+  uint32_t order;
+  int32_t parent;
+} IndexedElement;
+
+typedef struct _SpatialIndex {
+  /* The leaves, in STR order. */
+  std::vector<IndexedElement> elements;
+  /* Node boxes, the level right above the leaves first and the root last.
+   * Level l starts at level_start[l]; level_start has one extra entry for
+   * the end. */
+  std::vector<Box> nodes;
+  std::vector<size_t> level_start;
+} SpatialIndex;
+
+/* parents may be empty, in which case every element gets -1. Empty boxes
+ * are left out of the index. */
+void buildSpatialIndex(SpatialIndex *index, std::vector<Box> const& boxes, std::vector<int> const& parents);
+void clearSpatialIndex(SpatialIndex *index);
+
+/* Appends every element whose box intersects `area`, in no particular order. */
+void querySpatialIndex(const SpatialIndex *index, Box area, std::vector<const IndexedElement*> *hits);
+/* The element drawn last, so on top, among those whose box contains `p`, or
+ * NULL. */
+const IndexedElement *hitTestSpatialIndex(const SpatialIndex *index, Point p);
+
+#endif
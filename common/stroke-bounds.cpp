@@ -0,0 +1,522 @@
+#include <cmath>
+#include <limits>
+
+#include "stroke-bounds.h"
+
+static const double EPSILON = 1e-9;
+/* Past this many dashes the stroke is bounded as if it were undashed, which
+ * only loses the gaps. */
+static const double MAX_DASHES = 100000;
+
+static Point normalize(Point p)
+{
+  double l = length(p);
+  if (l < EPSILON)
+  {
+    Point zero = {0, 0};
+    return zero;
+  }
+  Point n = {p.x / l, p.y / l};
+  return n;
+}
+
+/* Left hand normal of a unit tangent. */
+static Point normalOf(Point t)
+{
+  Point n = {-t.y, t.x};
+  return n;
+}
+
+static double cross(Point a, Point b)
+{
+  return a.x * b.y - a.y * b.x;
+}
+
+static bool segmentIsDegenerate(const Segment *segment)
+{
+  if (segment->type == SEGMENT_ARC)
+    return segment->sweep == 0 || (segment->radii.x == 0 && segment->radii.y == 0);
+  for (int i = 1; i < 4; i++)
+  {
+    if (fabs(segment->p[i].x - segment->p[0].x) > EPSILON || fabs(segment->p[i].y - segment->p[0].y) > EPSILON)
+      return false;
+  }
+  return true;
+}
+
+/* Unit tangent at t = 0 or t = 1. Cubics whose control point coincides with
+ * the end point fall back to the next distinct control point. */
+static Point segmentTangent(const Segment *segment, bool at_end)
+{
+  Point d = segmentDerivative(segment, at_end ? 1 : 0);
+  if (length(d) > EPSILON || segment->type != SEGMENT_CUBIC)
+    return normalize(d);
+  const Point *p = segment->p;
+  Point candidates[2];
+  if (at_end)
+  {
+    candidates[0] = {p[3].x - p[1].x, p[3].y - p[1].y};
+    candidates[1] = {p[3].x - p[0].x, p[3].y - p[0].y};
+  }
+  else
+  {
+    candidates[0] = {p[2].x - p[0].x, p[2].y - p[0].y};
+    candidates[1] = {p[3].x - p[0].x, p[3].y - p[0].y};
+  }
+  for (int i = 0; i < 2; i++)
+  {
+    if (length(candidates[i]) > EPSILON)
+      return normalize(candidates[i]);
+  }
+  return normalize(d);
+}
+
+/* The two corners of the butt end at p: dot(u, p) + h|dot(u, n)|. */
+static double cornerSupport(Point p, Point tangent, double h, Point u)
+{
+  return dot(u, p) + h * fabs(dot(u, normalOf(tangent)));
+}
+
+/* Whether the direction u falls inside the cone swept from a to b, turning
+ * the short way round. */
+static bool inCone(Point a, Point b, Point u)
+{
+  double turn = cross(a, b);
+  if (turn >= 0)
+    return cross(a, u) >= 0 && cross(u, b) >= 0;
+  return cross(a, u) <= 0 && cross(u, b) <= 0;
+}
+
+/* The cap at end point p of a stroke leaving in direction `outward`. A butt
+ * cap adds nothing past the corners, a square cap is the h x 2h rectangle in
+ * front of them and a round cap the half disk. */
+static double capSupport(Point p, Point outward, double h, CapStyle cap, Point u)
+{
+  double corners = dot(u, p) + h * fabs(dot(u, normalOf(outward)));
+  if (cap == CAP_SQUARE)
+    return corners + h * fmax(0.0, dot(u, outward));
+  if (cap == CAP_ROUND && dot(u, outward) >= 0)
+    return dot(u, p) + h * length(u);
+  return corners;
+}
+
+static double joinSupport(Point p, Point in, Point out, double h, const StrokeParams *stroke, Point u)
+{
+  double turn = cross(in, out);
+  double cosine = dot(in, out);
+  if (fabs(turn) < EPSILON && cosine > 0)
+    return -std::numeric_limits<double>::infinity();
+
+  /* The outside of the corner is to the right of a left turn. */
+  Point a = normalOf(in);
+  Point b = normalOf(out);
+  if (turn > 0)
+  {
+    a.x = -a.x; a.y = -a.y;
+    b.x = -b.x; b.y = -b.y;
+  }
+
+  /* Bevel: the outer corners are already covered by the segment ends. */
+  double support = -std::numeric_limits<double>::infinity();
+  if (stroke->join == JOIN_ROUND)
+  {
+    /* A U-turn has no short way round: its outside is the half disk ahead. */
+    bool reversed = fabs(turn) < EPSILON;
+    if (reversed ? dot(u, in) >= 0 : inCone(a, b, u))
+      support = dot(u, p) + h * length(u);
+  }
+  else if (stroke->join == JOIN_MITER)
+  {
+    /* The miter length over the stroke width is 1 / sin(phi / 2) for an
+     * interior angle phi, which is 1 / cos(turn / 2). */
+    double half_cos = sqrt(fmax(0.0, (1 + cosine) / 2));
+    if (half_cos > EPSILON && 1.0 / half_cos <= stroke->miter_limit)
+    {
+      Point bisector = normalize({a.x + b.x, a.y + b.y});
+      Point tip = {p.x + bisector.x * h / half_cos, p.y + bisector.y * h / half_cos};
+      support = dot(u, tip);
+    }
+  }
+  return support;
+}
+
+static Segment subSegment(const Segment *segment, double t0, double t1);
+
+/* Both edges of the stroke at parameter t. */
+static double edgeSupport(const Segment *segment, double t, double h, Point u)
+{
+  Point d = segmentDerivative(segment, t);
+  if (length(d) < EPSILON)
+    return -std::numeric_limits<double>::infinity();
+  return cornerSupport(segmentPoint(segment, t), normalize(d), h, u);
+}
+
+/* The cone between a and b holding every nonzero direction in v, or false if
+ * they don't fit in less than a half turn. */
+static bool directionCone(const Point *v, int n, Point *a, Point *b)
+{
+  for (int i = 0; i < n; i++)
+  {
+    for (int j = 0; j < n; j++)
+    {
+      if (length(v[i]) < EPSILON || length(v[j]) < EPSILON || (i != j && cross(v[i], v[j]) <= 0))
+        continue;
+      bool holds = true;
+      for (int k = 0; k < n && holds; k++)
+      {
+        if (length(v[k]) >= EPSILON)
+          holds = cross(v[i], v[k]) >= 0 && cross(v[k], v[j]) >= 0;
+      }
+      if (holds)
+      {
+        *a = normalize(v[i]);
+        *b = normalize(v[j]);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* An upper bound on the edge support of segment over [t0, t1]: the largest
+ * dot(u, P) plus h times the largest |dot(u, N)| over the cone of tangents. */
+static double pieceSupportBound(const Segment *segment, double t0, double t1, double h, Point u)
+{
+  Segment piece = subSegment(segment, t0, t1);
+  double ts[4];
+  double position = fmax(dot(u, piece.p[0]), dot(u, piece.p[3]));
+  int count = segmentCriticalPoints(&piece, u, ts);
+  for (int i = 0; i < count; i++)
+    position = fmax(position, dot(u, segmentPoint(&piece, ts[i])));
+
+  /* Cubic tangents stay within the hodograph's control vectors; arc pieces
+   * are under a half turn, so theirs lie between the end tangents. */
+  Point v[3];
+  int n = 0;
+  if (piece.type == SEGMENT_CUBIC)
+  {
+    for (int i = 0; i < 3; i++)
+      v[n++] = {piece.p[i + 1].x - piece.p[i].x, piece.p[i + 1].y - piece.p[i].y};
+  }
+  else
+  {
+    v[n++] = segmentDerivative(&piece, 0);
+    v[n++] = segmentDerivative(&piece, 1);
+  }
+  Point a, b;
+  if (!directionCone(v, n, &a, &b))
+    return position + h * length(u);
+  Point perpendicular = normalOf(u);
+  Point opposite = {-perpendicular.x, -perpendicular.y};
+  if (inCone(a, b, perpendicular) || inCone(a, b, opposite))
+    return position + h * length(u);
+  return position + h * fmax(fabs(cross(a, u)), fabs(cross(b, u)));
+}
+
+#define EDGE_MAX_DEPTH 20
+
+/* Where the curvature of a segment exceeds 1 / h its offset edges fold back
+ * in cusps, which stick out further than the points with a tangent
+ * perpendicular to u. Rather than solve for them, bisect the segment and
+ * throw away the pieces whose bound can't beat `support`; what is left at
+ * the last level is counted whole, so the result never falls short. */
+static double curveEdgeSupport(const Segment *segment, double h, Point u, double support)
+{
+  typedef struct _Interval {
+    double t0;
+    double t1;
+    int depth;
+  } Interval;
+
+  Interval stack[EDGE_MAX_DEPTH + 8];
+  int top = 0;
+  /* Quarter turns at most, so the arc tangent cones stay under a half turn. */
+  int pieces = 1;
+  if (segment->type == SEGMENT_ARC)
+    pieces = (int)fmin(8.0, fmax(1.0, ceil(fabs(segment->sweep) / (M_PI / 2))));
+  for (int i = 0; i < pieces; i++)
+    stack[top++] = {(double)i / pieces, (double)(i + 1) / pieces, 0};
+
+  double tolerance = 1e-9 * (fabs(support) + h * length(u) + 1);
+  double leftover = -std::numeric_limits<double>::infinity();
+  while (top > 0)
+  {
+    Interval interval = stack[--top];
+    double bound = pieceSupportBound(segment, interval.t0, interval.t1, h, u);
+    if (bound <= support)
+      continue;
+    double mid = (interval.t0 + interval.t1) / 2;
+    support = fmax(support, edgeSupport(segment, mid, h, u));
+    if (bound - support <= tolerance || interval.depth == EDGE_MAX_DEPTH)
+    {
+      leftover = fmax(leftover, bound);
+      continue;
+    }
+    stack[top++] = {interval.t0, mid, interval.depth + 1};
+    stack[top++] = {mid, interval.t1, interval.depth + 1};
+  }
+  return fmax(support, leftover);
+}
+
+static double subpathSupport(const Subpath *subpath, const StrokeParams *stroke, Point u)
+{
+  double h = stroke->width / 2.0;
+  double support = -std::numeric_limits<double>::infinity();
+  double ts[4];
+
+  std::vector<const Segment*> segments;
+  for (auto const& segment: subpath->segments)
+  {
+    if (!segmentIsDegenerate(&segment))
+      segments.push_back(&segment);
+  }
+
+  if (segments.empty())
+  {
+    /* A zero length subpath still paints its caps, as a square facing
+     * subpath->direction. */
+    if (subpath->segments.empty())
+      return support;
+    Point p = subpath->start;
+    Point d = subpath->direction;
+    if (stroke->cap == CAP_ROUND)
+      return dot(u, p) + h * length(u);
+    if (stroke->cap == CAP_SQUARE)
+      return dot(u, p) + h * (fabs(dot(u, d)) + fabs(dot(u, normalOf(d))));
+    return support;
+  }
+
+  for (size_t i = 0; i < segments.size(); i++)
+  {
+    const Segment *segment = segments[i];
+    Point start_tangent = segmentTangent(segment, false);
+    Point end_tangent = segmentTangent(segment, true);
+    support = fmax(support, cornerSupport(segment->p[0], start_tangent, h, u));
+    support = fmax(support, cornerSupport(segment->p[3], end_tangent, h, u));
+    int count = segmentCriticalPoints(segment, u, ts);
+    for (int j = 0; j < count; j++)
+      support = fmax(support, dot(u, segmentPoint(segment, ts[j])) + h * length(u));
+    if (segment->type != SEGMENT_LINE)
+      support = curveEdgeSupport(segment, h, u, support);
+
+    bool has_next = i + 1 < segments.size() || subpath->closed;
+    if (has_next)
+    {
+      const Segment *next = segments[(i + 1) % segments.size()];
+      support = fmax(support, joinSupport(segment->p[3], end_tangent, segmentTangent(next, false), h, stroke, u));
+    }
+  }
+
+  if (!subpath->closed)
+  {
+    const Segment *first = segments.front();
+    const Segment *last = segments.back();
+    Point start_out = segmentTangent(first, false);
+    start_out.x = -start_out.x;
+    start_out.y = -start_out.y;
+    support = fmax(support, capSupport(first->p[0], start_out, h, stroke->cap, u));
+    support = fmax(support, capSupport(last->p[3], segmentTangent(last, true), h, stroke->cap, u));
+  }
+  return support;
+}
+
+double strokeSupport(const PathGeometry *path, const StrokeParams *stroke, Point u)
+{
+  double support = -std::numeric_limits<double>::infinity();
+  for (auto const& subpath: path->subpaths)
+    support = fmax(support, subpathSupport(&subpath, stroke, u));
+  return support;
+}
+
+/* 8 point Gauss-Legendre weights and abscissae on [-1, 1]. */
+static const double GAUSS_X[8] = {-0.9602898564975363, -0.7966664774136267, -0.5255324099163290, -0.1834346424956498,
+                                   0.1834346424956498, 0.5255324099163290, 0.7966664774136267, 0.9602898564975363};
+static const double GAUSS_W[8] = {0.1012285362903763, 0.2223810344533745, 0.3137066458778873, 0.3626837833783620,
+                                  0.3626837833783620, 0.3137066458778873, 0.2223810344533745, 0.1012285362903763};
+
+static double segmentLength(const Segment *segment, double t0, double t1)
+{
+  if (segment->type == SEGMENT_LINE)
+    return length(segmentDerivative(segment, 0)) * (t1 - t0);
+  double half = (t1 - t0) / 2;
+  double mid = (t1 + t0) / 2;
+  double total = 0;
+  for (int i = 0; i < 8; i++)
+    total += GAUSS_W[i] * length(segmentDerivative(segment, mid + half * GAUSS_X[i]));
+  return total * half;
+}
+
+/* Parameter t at which the length from t = 0 reaches `target`. */
+static double segmentParameterAt(const Segment *segment, double target, double total)
+{
+  if (segment->type == SEGMENT_LINE || total <= 0)
+    return total <= 0 ? 0 : target / total;
+  double lo = 0;
+  double hi = 1;
+  double t = target / total;
+  for (int i = 0; i < 20; i++)
+  {
+    double l = segmentLength(segment, 0, t);
+    if (fabs(l - target) < 1e-6 * total)
+      break;
+    if (l < target)
+      lo = t;
+    else
+      hi = t;
+    double speed = length(segmentDerivative(segment, t));
+    double next = speed > EPSILON ? t - (l - target) / speed : (lo + hi) / 2;
+    t = (next > lo && next < hi) ? next : (lo + hi) / 2;
+  }
+  return t;
+}
+
+static Point lerp(Point a, Point b, double t)
+{
+  Point p = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+  return p;
+}
+
+static Segment subSegment(const Segment *segment, double t0, double t1)
+{
+  Segment piece = *segment;
+  if (segment->type == SEGMENT_ARC)
+  {
+    piece.start_angle = segment->start_angle + t0 * segment->sweep;
+    piece.sweep = (t1 - t0) * segment->sweep;
+    piece.p[0] = segmentPoint(segment, t0);
+    piece.p[3] = segmentPoint(segment, t1);
+    piece.p[1] = piece.p[0];
+    piece.p[2] = piece.p[3];
+  }
+  else if (segment->type == SEGMENT_LINE)
+  {
+    piece.p[0] = piece.p[1] = segmentPoint(segment, t0);
+    piece.p[2] = piece.p[3] = segmentPoint(segment, t1);
+  }
+  else
+  {
+    /* Blossom the cubic at (t0, t0, t0), (t0, t0, t1), (t0, t1, t1), (t1, t1, t1). */
+    const Point *p = segment->p;
+    auto blossom = [p](double a, double b, double c) {
+      Point q0 = lerp(p[0], p[1], a), q1 = lerp(p[1], p[2], a), q2 = lerp(p[2], p[3], a);
+      Point r0 = lerp(q0, q1, b), r1 = lerp(q1, q2, b);
+      return lerp(r0, r1, c);
+    };
+    piece.p[0] = blossom(t0, t0, t0);
+    piece.p[1] = blossom(t0, t0, t1);
+    piece.p[2] = blossom(t0, t1, t1);
+    piece.p[3] = blossom(t1, t1, t1);
+  }
+  return piece;
+}
+
+bool dashPath(const PathGeometry *path, const std::vector<double>& dashes, double dash_offset, PathGeometry *dashed)
+{
+  std::vector<double> pattern = dashes;
+  double period = 0;
+  for (double dash: pattern)
+  {
+    if (dash < 0)
+      return false;
+    period += dash;
+  }
+  if (pattern.empty() || period <= 0)
+    return false;
+  /* An odd number of values is repeated to get an even one. */
+  if (pattern.size() % 2 == 1)
+  {
+    pattern.insert(pattern.end(), dashes.begin(), dashes.end());
+    period *= 2;
+  }
+  /* Each subpath has at most one dash per pattern entry per period, plus
+   * the one it starts in. */
+  double count = 0;
+  for (auto const& subpath: path->subpaths)
+  {
+    double total = 0;
+    for (auto const& segment: subpath.segments)
+      total += segmentLength(&segment, 0, 1);
+    count += (total / period + 1) * pattern.size() / 2;
+  }
+  if (count > MAX_DASHES)
+    return false;
+
+  dashed->subpaths.clear();
+  for (auto const& subpath: path->subpaths)
+  {
+    /* Every subpath starts the pattern afresh at dash_offset. */
+    double offset = fmod(dash_offset, period);
+    if (offset < 0)
+      offset += period;
+    size_t index = 0;
+    /* A zero length dash right at the offset is still drawn. */
+    while (offset > pattern[index] || (offset == pattern[index] && pattern[index] > 0))
+    {
+      offset -= pattern[index];
+      index = (index + 1) % pattern.size();
+    }
+    double remaining = pattern[index] - offset;
+    bool on = index % 2 == 0;
+    bool open = false;
+
+    for (auto const& segment: subpath.segments)
+    {
+      double total = segmentLength(&segment, 0, 1);
+      double position = 0;
+      while (position < total)
+      {
+        double step = fmin(remaining, total - position);
+        if (on && step >= 0)
+        {
+          double t0 = segmentParameterAt(&segment, position, total);
+          double t1 = segmentParameterAt(&segment, position + step, total);
+          if (!open)
+          {
+            Subpath piece;
+            piece.start = segmentPoint(&segment, t0);
+            piece.closed = false;
+            /* Faces along the path should the dash have no length. */
+            Point direction = normalize(segmentDerivative(&segment, t0));
+            if (length(direction) > 0)
+              piece.direction = direction;
+            dashed->subpaths.push_back(piece);
+            open = true;
+          }
+          dashed->subpaths.back().segments.push_back(subSegment(&segment, t0, t1));
+        }
+        position += step;
+        remaining -= step;
+        if (remaining <= 0)
+        {
+          index = (index + 1) % pattern.size();
+          remaining = pattern[index];
+          on = index % 2 == 0;
+          open = false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+Box transformedStrokeBounds(const PathGeometry *path, const StrokeParams *stroke, Matrix m)
+{
+  if (stroke->width <= 0)
+    return emptyBox();
+
+  PathGeometry dashed;
+  const PathGeometry *geometry = path;
+  if (dashPath(path, stroke->dashes, stroke->dash_offset, &dashed))
+    geometry = &dashed;
+
+  bool has_subpaths = false;
+  for (auto const& subpath: geometry->subpaths)
+    has_subpaths = has_subpaths || !subpath.segments.empty();
+  if (!has_subpaths)
+    return emptyBox();
+
+  Box box = boundsFromSupport(m, [geometry, stroke](Point u) { return strokeSupport(geometry, stroke, u); });
+  if (boxIsEmpty(box))
+    return emptyBox();
+  return box;
+}
@@ -0,0 +1,46 @@
+#ifndef STROKE_BOUNDS_H
+#define STROKE_BOUNDS_H
+
+#include <vector>
+
+#include "geometry.h"
+
+typedef enum _CapStyle {
+  CAP_BUTT = 0,
+  CAP_ROUND = 1,
+  CAP_SQUARE = 2
+} CapStyle;
+
+typedef enum _JoinStyle {
+  JOIN_MITER = 0,
+  JOIN_ROUND = 1,
+  JOIN_BEVEL = 2
+} JoinStyle;
+
+typedef struct _StrokeParams {
+  double width;
+  CapStyle cap;
+  JoinStyle join;
+  double miter_limit;
+  std::vector<double> dashes;
+  double dash_offset;
+} StrokeParams;
+
+/* Support function of the stroked outline: the largest dot(u, p) over every
+ * point p the stroke covers. Computed per segment, cap and join without
+ * building the outline. Along a segment the extremes are either the end
+ * corners P +- hN or the points where the tangent is perpendicular to u,
+ * where the stroke reaches dot(u, P) + h|u|. */
+double strokeSupport(const PathGeometry *path, const StrokeParams *stroke, Point u);
+
+/* Exact bounds of the stroke under any affine matrix. The stroke is built in
+ * local space, so a non uniform matrix correctly turns the pen elliptic. */
+Box transformedStrokeBounds(const PathGeometry *path, const StrokeParams *stroke, Matrix m);
+
+/* Splits a path into open subpaths, one per dash. Returns false when the
+ * dash array doesn't dash anything (empty, all zero or negative), or when it
+ * would make more dashes than are worth bounding one by one; the stroke is
+ * then bounded undashed. A zero length dash faces along the path. */
+bool dashPath(const PathGeometry *path, const std::vector<double>& dashes, double dash_offset, PathGeometry *dashed);
+
+#endif
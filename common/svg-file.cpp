@@ -0,0 +1,277 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "svg-file.h"
+
+static int readWholeFile(int fd, SVGFile *file)
+{
+  file->buffer = (char*)malloc(file->size + 1);
+  if (!file->buffer)
+    return 1;
+  size_t done = 0;
+  while (done < file->size)
+  {
+    ssize_t n = read(fd, file->buffer + done, file->size - done);
+    if (n <= 0)
+    {
+      free(file->buffer);
+      file->buffer = NULL;
+      return 1;
+    }
+    done += n;
+  }
+  file->buffer[file->size] = '\0';
+  file->data = file->buffer;
+  return 0;
+}
+
+int openSVGFile(std::string filename, SVGFile *file)
+{
+  file->data = NULL;
+  file->size = 0;
+  file->mapping = NULL;
+  file->mapping_size = 0;
+  file->buffer = NULL;
+  file->source.path.clear();
+  file->source.size = 0;
+  file->source.mtime_sec = 0;
+  file->source.mtime_nsec = 0;
+  clearSnapshot(&file->snapshot);
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Failed to open %s\n", filename.c_str());
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return 1;
+  }
+  file->size = st.st_size;
+  file->source.size = st.st_size;
+  file->source.mtime_sec = st.st_mtim.tv_sec;
+  file->source.mtime_nsec = st.st_mtim.tv_nsec;
+
+  if (file->size == 0)
+  {
+    close(fd);
+    file->data = "";
+    return 0;
+  }
+
+  /* The kernel zero fills the tail of the last mapped page, so when the file
+   * doesn't end exactly on a page boundary the mapping is already NUL
+   * terminated. Otherwise there is no room for the terminator and we fall
+   * back to reading into a buffer one byte larger than the file. */
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (file->size % page_size != 0)
+  {
+    void *mapping = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED)
+    {
+      madvise(mapping, file->size, MADV_SEQUENTIAL);
+      file->mapping = mapping;
+      file->mapping_size = file->size;
+      file->data = (const char*)mapping;
+      close(fd);
+      return 0;
+    }
+  }
+
+  int status = readWholeFile(fd, file);
+  close(fd);
+  return status;
+}
+
+void closeSVGFile(SVGFile *file)
+{
+  if (file->mapping)
+    munmap(file->mapping, file->mapping_size);
+  if (file->buffer)
+    free(file->buffer);
+  closeSnapshot(&file->snapshot);
+  file->data = NULL;
+  file->size = 0;
+  file->mapping = NULL;
+  file->mapping_size = 0;
+  file->buffer = NULL;
+}
+
+void collectSVGFiles(std::string path, std::vector<std::string> *files)
+{
+  if (!std::filesystem::is_directory(path))
+  {
+    files->push_back(path);
+    return;
+  }
+  std::vector<std::string> found;
+  for (auto const& entry: std::filesystem::recursive_directory_iterator(path))
+  {
+    if (entry.is_regular_file() && entry.path().extension() == ".svg")
+      found.push_back(entry.path().string());
+  }
+  std::sort(found.begin(), found.end());
+  files->insert(files->end(), found.begin(), found.end());
+}
+
+static std::string localName(std::string const& name)
+{
+  size_t colon = name.find(':');
+  return colon == std::string::npos ? name : name.substr(colon + 1);
+}
+
+static bool isDrawableElement(std::string const& name)
+{
+  static const char *drawable[] = {"path", "rect", "circle", "ellipse", "line", "polyline", "polygon", "image", "use"};
+  for (const char *candidate: drawable)
+    if (name == candidate)
+      return true;
+  return false;
+}
+
+static bool isHiddenContainer(std::string const& name)
+{
+  static const char *hidden[] = {"defs", "symbol", "clipPath", "mask", "pattern", "marker", "linearGradient",
+                                 "radialGradient", "filter", "title", "desc", "metadata", "style", "script"};
+  for (const char *candidate: hidden)
+    if (name == candidate)
+      return true;
+  return false;
+}
+
+/* Returns the end of `[from, end)` after `terminator`, or `end`. */
+static const char *skipPast(const char *from, const char *end, const char *terminator)
+{
+  size_t length = strlen(terminator);
+  for (const char *p = from; p + length <= end; p++)
+    if (memcmp(p, terminator, length) == 0)
+      return p + length;
+  return end;
+}
+
+/* Value of the id attribute in the attributes of a start tag, `[p, end)`. */
+static bool findId(const char *p, const char *end, std::string *id)
+{
+  while (p < end)
+  {
+    while (p < end && (isspace((unsigned char)*p) || *p == '/'))
+      p++;
+    const char *name = p;
+    while (p < end && *p != '=' && !isspace((unsigned char)*p))
+      p++;
+    std::string attribute(name, p);
+    while (p < end && (isspace((unsigned char)*p) || *p == '='))
+      p++;
+    if (p >= end || (*p != '"' && *p != '\''))
+      return false;
+    char quote = *p++;
+    const char *value = p;
+    while (p < end && *p != quote)
+      p++;
+    if (attribute == "id")
+    {
+      id->assign(value, p);
+      return true;
+    }
+    p++;
+  }
+  return false;
+}
+
+void tagDrawableElements(SVGFile *file, std::string *tagged, std::vector<std::string> *ids)
+{
+  const char *p = file->data;
+  const char *end = file->data + file->size;
+  /* Whether each open element is inside a never rendered container. */
+  std::vector<bool> hidden_stack;
+  int generated = 0;
+  tagged->clear();
+  tagged->reserve(file->size + file->size / 8);
+  ids->clear();
+
+  while (p < end)
+  {
+    const char *open = (const char*)memchr(p, '<', end - p);
+    if (!open)
+    {
+      tagged->append(p, end);
+      break;
+    }
+    tagged->append(p, open);
+
+    const char *close;
+    if (end - open >= 4 && memcmp(open, "<!--", 4) == 0)
+      close = skipPast(open, end, "-->");
+    else if (end - open >= 9 && memcmp(open, "<![CDATA[", 9) == 0)
+      close = skipPast(open, end, "]]>");
+    else if (end - open >= 2 && open[1] == '?')
+      close = skipPast(open, end, "?>");
+    else if (end - open >= 2 && open[1] == '!')
+    {
+      const char *bracket = (const char*)memchr(open, '[', end - open);
+      const char *gt = skipPast(open, end, ">");
+      close = bracket && bracket < gt ? skipPast(bracket, end, "]>") : gt;
+    }
+    else
+    {
+      /* A start or end tag. '>' may appear inside quoted attribute values. */
+      char quote = 0;
+      close = open + 1;
+      while (close < end && (quote || *close != '>'))
+      {
+        if (quote && *close == quote)
+          quote = 0;
+        else if (!quote && (*close == '"' || *close == '\''))
+          quote = *close;
+        close++;
+      }
+      if (close < end)
+        close++;
+
+      if (open[1] == '/')
+      {
+        if (!hidden_stack.empty())
+          hidden_stack.pop_back();
+      }
+      else
+      {
+        const char *name_end = open + 1;
+        while (name_end < close && !isspace((unsigned char)*name_end) && *name_end != '/' && *name_end != '>')
+          name_end++;
+        std::string name = localName(std::string(open + 1, name_end));
+        bool hidden = !hidden_stack.empty() && hidden_stack.back();
+        bool self_closing = close - open >= 2 && close[-2] == '/';
+
+        if (!hidden && isDrawableElement(name))
+        {
+          std::string id;
+          if (!findId(name_end, close - 1, &id))
+          {
+            id = "svg-bbox-element-" + std::to_string(generated++);
+            tagged->append(open, name_end);
+            tagged->append(" id=\"" + id + "\"");
+            open = name_end;
+          }
+          ids->push_back(id);
+        }
+        if (!self_closing)
+          hidden_stack.push_back(hidden || isHiddenContainer(name));
+      }
+    }
+    tagged->append(open, close);
+    p = close;
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef SVG_FILE_H
+#define SVG_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "snapshot.h"
+
+/* The bytes of an SVG file, either memory mapped or read with a single
+ * sized read. data is always NUL terminated so it can be handed to
+ * SVGDocument::CreateSVGDocument directly, and size is the real length
+ * for librsvg. source has the size and modification time of the open file,
+ * and its path is filled in by loadSnapshot. snapshot is only mapped once
+ * loadSnapshot has found or written a fresh snapshot of the file. */
+typedef struct _SVGFile {
+  const char *data;
+  size_t size;
+  void *mapping;
+  size_t mapping_size;
+  char *buffer;
+  SnapshotSource source;
+  SVGSnapshot snapshot;
+} SVGFile;
+
+/* Returns 0 on success and 1 if the file could not be read. */
+int openSVGFile(std::string filename, SVGFile *file);
+void closeSVGFile(SVGFile *file);
+
+/* Adds `path` if it is a file, or every .svg file below it (sorted) if it is
+ * a directory. */
+void collectSVGFiles(std::string path, std::vector<std::string> *files);
+
+/* Copies the document into `tagged`, adding an id to every drawable element
+ * (shapes, images and <use>) that is rendered in place, i.e. not inside
+ * <defs>, <symbol>, <clipPath> and the like. `ids` gets the id of each of
+ * those elements in document order, existing ones included, so that they can
+ * be looked up one at a time. */
+void tagDrawableElements(SVGFile *file, std::string *tagged, std::vector<std::string> *ids);
+
+#endif
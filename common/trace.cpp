@@ -0,0 +1,163 @@
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <atomic>
+
+#include "trace.h"
+
+/* Events kept per thread, about 1.5 MB each. */
+#define TRACE_BUFFER_EVENTS 65536
+
+typedef struct _TraceEvent {
+  const char *name;
+  uint64_t start;
+  uint64_t duration;
+} TraceEvent;
+
+typedef struct _TraceBuffer {
+  int tid;
+  const char *thread_name;
+  uint64_t written;
+  TraceEvent events[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+static std::atomic<bool> trace_enabled(false);
+static const char *trace_path = NULL;
+static std::chrono::steady_clock::time_point trace_origin;
+/* Buffers outlive their threads so worker pools can exit before the flush.
+ * A thread that exits hands its buffer on to the next thread that traces,
+ * keeping its events, so threads started per frame share a few tracks
+ * rather than each taking a new buffer. */
+static std::mutex trace_mutex;
+static std::vector<TraceBuffer*> trace_buffers;
+static std::vector<TraceBuffer*> trace_free_buffers;
+
+typedef struct _TraceBufferOwner {
+  TraceBuffer *buffer = NULL;
+  ~_TraceBufferOwner()
+  {
+    if (!buffer)
+      return;
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_free_buffers.push_back(buffer);
+  }
+} TraceBufferOwner;
+
+static thread_local TraceBufferOwner trace_owner;
+
+void traceInitialize(const char *path)
+{
+  trace_path = path;
+  trace_origin = std::chrono::steady_clock::now();
+  trace_enabled = path != NULL;
+}
+
+bool traceEnabled()
+{
+  return trace_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t traceNow()
+{
+  /* Offset by one so that 0 can mean "not recording" in TraceScope. */
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - trace_origin).count() + 1;
+}
+
+static TraceBuffer *threadBuffer()
+{
+  if (!trace_owner.buffer)
+  {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    if (!trace_free_buffers.empty())
+    {
+      trace_owner.buffer = trace_free_buffers.back();
+      trace_free_buffers.pop_back();
+    }
+    else
+    {
+      TraceBuffer *buffer = new TraceBuffer;
+      buffer->thread_name = NULL;
+      buffer->written = 0;
+      buffer->tid = (int)trace_buffers.size() + 1;
+      trace_buffers.push_back(buffer);
+      trace_owner.buffer = buffer;
+    }
+  }
+  return trace_owner.buffer;
+}
+
+void traceSetThreadName(const char *name)
+{
+  if (traceEnabled())
+    threadBuffer()->thread_name = name;
+}
+
+void traceComplete(const char *name, uint64_t start_us, uint64_t end_us)
+{
+  if (!traceEnabled())
+    return;
+  TraceBuffer *buffer = threadBuffer();
+  TraceEvent *event = &buffer->events[buffer->written % TRACE_BUFFER_EVENTS];
+  event->name = name;
+  event->start = start_us - 1;
+  event->duration = end_us - start_us;
+  buffer->written++;
+}
+
+static void writeJSONString(FILE *file, const char *text)
+{
+  fputc('"', file);
+  for (const char *c = text; *c; c++)
+  {
+    if (*c == '"' || *c == '\\')
+      fprintf(file, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20)
+      fprintf(file, "\\u%04x", *c);
+    else
+      fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+void traceFlush()
+{
+  if (!traceEnabled())
+    return;
+  trace_enabled = false;
+
+  FILE *file = fopen(trace_path, "w");
+  if (!file)
+  {
+    fprintf(stderr, "could not write trace to %s\n", trace_path);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  bool first = true;
+  for (TraceBuffer *buffer: trace_buffers)
+  {
+    if (buffer->thread_name)
+    {
+      fprintf(file, "%s\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"name\": \"thread_name\", \"args\": {\"name\": ",
+              first ? "" : ",", buffer->tid);
+      writeJSONString(file, buffer->thread_name);
+      fprintf(file, "}}");
+      first = false;
+    }
+    /* Oldest surviving event first. */
+    uint64_t begin = buffer->written > TRACE_BUFFER_EVENTS ? buffer->written - TRACE_BUFFER_EVENTS : 0;
+    for (uint64_t i = begin; i < buffer->written; i++)
+    {
+      TraceEvent *event = &buffer->events[i % TRACE_BUFFER_EVENTS];
+      fprintf(file, "%s\n{\"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lu, \"dur\": %lu, \"name\": ",
+              first ? "" : ",", buffer->tid, (unsigned long)event->start, (unsigned long)event->duration);
+      writeJSONString(file, event->name);
+      fprintf(file, "}");
+      first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+}
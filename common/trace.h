@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+
+/* Chrome trace event recording, loadable in Perfetto or chrome://tracing.
+ * Each thread writes complete ("X") events into its own ring buffer without
+ * locking; when a buffer is full the oldest events are overwritten. Nothing
+ * is recorded unless traceInitialize was given a path. */
+
+/* path may be NULL, which leaves tracing off. */
+void traceInitialize(const char *path);
+/* Writes every thread's events to the path. Call once at exit, after the
+ * threads that trace have been joined. */
+void traceFlush();
+bool traceEnabled();
+
+/* Names must outlive the trace, string literals in practice. */
+void traceSetThreadName(const char *name);
+uint64_t traceNow();
+void traceComplete(const char *name, uint64_t start_us, uint64_t end_us);
+
+/* Records the enclosing scope as one event. */
+typedef struct _TraceScope {
+  const char *name;
+  uint64_t start;
+  _TraceScope(const char *scope_name) : name(scope_name), start(traceEnabled() ? traceNow() : 0) {}
+  ~_TraceScope() { if (start) traceComplete(name, start, traceNow()); }
+} TraceScope;
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif
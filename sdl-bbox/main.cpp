@@ -2,6 +2,7 @@
 #include <fstream>
 #include <memory>
 #include <cstring>
+#include <algorithm>
 
 #include <SDL2/SDL.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -20,6 +21,9 @@
 #include <src/core/SkRTree.h>
 #include <SkPictureRecorder.h>
 
+#include "stroke-bounds.h"
+#include "frame.h"
+
 typedef enum _SVGRenderer {
   SNV = 0,
   LIBRSVG = 1
@@ -54,6 +58,8 @@ typedef struct _State {
   std::vector<std::string> test_names;
   int total_tests;
   int current_test;
+  /* Everything drawn in a frame is presented once, at the end of it. */
+  Frame frame;
 } State;
 
 typedef struct _Color {
@@ -106,7 +112,9 @@ int initialize(State *state, int width, int height) {
   cairo_close_path(state->cr);
   cairo_fill(state->cr);
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  initializeFrame(&state->frame, state->window, state->sdl_surface->w, state->sdl_surface->h);
+  damageFrameAll(&state->frame);
+  presentFrame(&state->frame);
 
   state->test_names.push_back(std::string("Cairo test 1 - Simple Rectangle Fill"));
   state->test_names.push_back(std::string("Cairo test 2 - Simple Rectangle Stroke"));
@@ -150,7 +158,7 @@ void clearCanvas(State *state)
   cairo_close_path(state->cr);
   cairo_fill(state->cr);
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void drawRectangle(State *state, double x0, double y0, double x1, double y1, Color color) {
@@ -163,7 +171,8 @@ void drawRectangle(State *state, double x0, double y0, double x1, double y1, Col
   cairo_close_path(state->cr);
   cairo_stroke(state->cr);
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameUserBox(&state->frame, state->cr, std::min(x0, x1) - 0.25, std::min(y0, y1) - 0.25,
+                     std::max(x0, x1) + 0.25, std::max(y0, y1) + 0.25, 1);
 }
 
 void zoomInTransform(State *state)
@@ -250,7 +259,7 @@ void drawRecording(State *state)
   double scale_x = state->width/width_box;
   double scale_y = state->height/height_box;
   gdk_pixbuf_scale(state->saved_pixbuf, state->pixbuf, 0, 0, state->width, state->height, -1 * state->x0 * scale_x, -1 * state->y0 * scale_y, scale_x, scale_y, GDK_INTERP_NEAREST);
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void calculateBoundingBoxCairo(std::string filename, double *x0, double *y0, double *width, double *height)
@@ -335,11 +344,94 @@ void drawInfoBox(State *state)
   cairo_move_to(state->cr, 10, 50);
   cairo_show_text(state->cr, characters);
 
+  sprintf(characters, "Present: %.2f ms (%d rects)", state->frame.present_ms, state->frame.present_rects);
+  cairo_move_to(state->cr, 10, 65);
+  cairo_show_text(state->cr, characters);
+
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  damageFrame(&state->frame, 0, 0, state->width, 70);
   cairo_restore(state->cr);
 }
 
+/* The cubic that traces the quad p[0], p[1], p[2]. */
+Segment quadSegment(const SkPoint *p)
+{
+  Segment segment;
+  segment.type = SEGMENT_CUBIC;
+  segment.p[0] = {p[0].x(), p[0].y()};
+  segment.p[1] = {p[0].x() + 2.0 / 3.0 * (p[1].x() - p[0].x()), p[0].y() + 2.0 / 3.0 * (p[1].y() - p[0].y())};
+  segment.p[2] = {p[2].x() + 2.0 / 3.0 * (p[1].x() - p[2].x()), p[2].y() + 2.0 / 3.0 * (p[1].y() - p[2].y())};
+  segment.p[3] = {p[2].x(), p[2].y()};
+  return segment;
+}
+
+/* Draws the exact stroke bounds from stroke-bounds.cpp in magenta, to compare
+ * against the blue computeFastBounds box. */
+void SkiaDrawExactStrokeBounds(State *state, const SkPath& path, const SkPaint& stroke_paint)
+{
+  PathGeometry geometry;
+  SkPath::Iter iter(path, false);
+  SkPoint pts[4];
+  SkPath::Verb verb;
+  while ((verb = iter.next(pts)) != SkPath::kDone_Verb)
+  {
+    Segment segment;
+    segment.type = SEGMENT_CUBIC;
+    switch (verb)
+    {
+      case SkPath::kMove_Verb:
+        geometry.subpaths.push_back(Subpath());
+        geometry.subpaths.back().start = {pts[0].x(), pts[0].y()};
+        geometry.subpaths.back().closed = false;
+        continue;
+      case SkPath::kLine_Verb:
+        segment.type = SEGMENT_LINE;
+        segment.p[0] = segment.p[1] = {pts[0].x(), pts[0].y()};
+        segment.p[2] = segment.p[3] = {pts[1].x(), pts[1].y()};
+        break;
+      case SkPath::kQuad_Verb:
+        segment = quadSegment(pts);
+        break;
+      case SkPath::kConic_Verb:
+      {
+        /* Arcs, ovals and round rects. 32 quads per conic put the error far
+         * below a pixel. */
+        SkPoint quads[1 + 2 * 32];
+        int count = SkPath::ConvertConicToQuads(pts[0], pts[1], pts[2], iter.conicWeight(), quads, 5);
+        for (int i = 0; i < count; i++)
+          geometry.subpaths.back().segments.push_back(quadSegment(&quads[2 * i]));
+        continue;
+      }
+      case SkPath::kCubic_Verb:
+        for (int i = 0; i < 4; i++)
+          segment.p[i] = {pts[i].x(), pts[i].y()};
+        break;
+      case SkPath::kClose_Verb:
+        geometry.subpaths.back().closed = true;
+        continue;
+      default:
+        continue;
+    }
+    geometry.subpaths.back().segments.push_back(segment);
+  }
+
+  StrokeParams stroke;
+  stroke.width = stroke_paint.getStrokeWidth();
+  stroke.cap = stroke_paint.getStrokeCap() == SkPaint::kRound_Cap ? CAP_ROUND :
+               stroke_paint.getStrokeCap() == SkPaint::kSquare_Cap ? CAP_SQUARE : CAP_BUTT;
+  stroke.join = stroke_paint.getStrokeJoin() == SkPaint::kRound_Join ? JOIN_ROUND :
+                stroke_paint.getStrokeJoin() == SkPaint::kBevel_Join ? JOIN_BEVEL : JOIN_MITER;
+  stroke.miter_limit = stroke_paint.getStrokeMiter();
+  stroke.dash_offset = 0;
+  Box box = transformedStrokeBounds(&geometry, &stroke, identityMatrix());
+
+  SkPaint exact_paint;
+  exact_paint.setAntiAlias(true);
+  exact_paint.setColor(SK_ColorMAGENTA);
+  exact_paint.setStyle(SkPaint::kStroke_Style);
+  state->skCanvas->drawRect(SkRect::MakeLTRB(box.x0, box.y0, box.x1, box.y1), exact_paint);
+}
+
 void SkiaTestRectangleFill(State *state){
   SkPath path;
   path.moveTo(100, 100);
@@ -361,7 +453,7 @@ void SkiaTestRectangleFill(State *state){
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestRectangleStrokeMiter(State *state){
@@ -395,8 +487,9 @@ void SkiaTestRectangleStrokeMiter(State *state){
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestRectangleStrokeRound(State *state){
@@ -430,8 +523,9 @@ void SkiaTestRectangleStrokeRound(State *state){
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestCubicFill(State *state)
@@ -458,7 +552,7 @@ void SkiaTestCubicFill(State *state)
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestCubicStrokeBevel(State *state)
@@ -495,8 +589,9 @@ void SkiaTestCubicStrokeBevel(State *state)
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestCubicStrokeRound(State *state)
@@ -533,8 +628,9 @@ void SkiaTestCubicStrokeRound(State *state)
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestCubicStrokeMiter(State *state)
@@ -572,8 +668,9 @@ void SkiaTestCubicStrokeMiter(State *state)
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestArcFill(State *state)
@@ -596,7 +693,7 @@ void SkiaTestArcFill(State *state)
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestRectangleRotateFill(State *state)
@@ -627,7 +724,7 @@ void SkiaTestRectangleRotateFill(State *state)
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestRectangleRotateStroke(State *state)
@@ -668,8 +765,9 @@ void SkiaTestRectangleRotateStroke(State *state)
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, new_path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestClippingSimple(State *state)
@@ -704,7 +802,7 @@ void SkiaTestClippingSimple(State *state)
   state->skCanvas->drawRect(tightBounds, bbox_paint);
   state->skCanvas->drawRect(tightBoundsClipPath, bbox_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestStrokedCurveButt(State *state)
@@ -732,8 +830,9 @@ void SkiaTestStrokedCurveButt(State *state)
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestStrokedCurveSquare(State *state)
@@ -761,8 +860,9 @@ void SkiaTestStrokedCurveSquare(State *state)
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void SkiaTestStrokedCurveRound(State *state)
@@ -790,8 +890,9 @@ void SkiaTestStrokedCurveRound(State *state)
   bbox_paint.setColor(SK_ColorBLUE);
   bbox_paint.setStyle(SkPaint::kStroke_Style);
   state->skCanvas->drawRect(tightBounds, bbox_paint);
+  SkiaDrawExactStrokeBounds(state, path, stroke_paint);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // Simple Rectangle from (100, 100) -> (399, 399)
@@ -813,7 +914,7 @@ void CairoTestRectangleFill(State *state){
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // Simple Rectangle from (100, 100) -> (399, 399)
@@ -835,7 +936,7 @@ void CairoTestRectangleStroke(State *state){
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // Cubic Bezier Curve (100, 100) l (400, 100) c (800, 100) (800, 400) (400, 400)
@@ -862,7 +963,7 @@ void CairoTestCubicFill(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // Same Cubic Bezier but with a stroke of width 50 and join being
@@ -900,7 +1001,7 @@ void CairoTestCubicStrokeBevel(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // Same Cubic Bezier but with a stroke of width 50 and join being
@@ -938,7 +1039,7 @@ void CairoTestCubicStrokeRound(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // A simple triangle that's filled and stroked with a miter join
@@ -973,7 +1074,7 @@ void CairoTestCubicStrokeMiter(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // An arc with a red fill formed by doing a circular arc and then
@@ -994,7 +1095,7 @@ void CairoTestArcFill(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 // A rectangle that's filled with red and rotated to demonstrate
@@ -1018,7 +1119,7 @@ void CairoTestRectangleRotateFill(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void CairoTestClippingSimple(State *state)
@@ -1051,7 +1152,7 @@ void CairoTestClippingSimple(State *state)
   cairo_rectangle(state->cr, path_x0, path_y0, path_x1 - path_x0 + 1, path_y1 - path_y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void CairoTestStrokedCurveButt(State *state)
@@ -1072,7 +1173,7 @@ void CairoTestStrokedCurveButt(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void CairoTestStrokedCurveSquare(State *state)
@@ -1093,7 +1194,7 @@ void CairoTestStrokedCurveSquare(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void CairoTestStrokedCurveRound(State *state)
@@ -1114,7 +1215,7 @@ void CairoTestStrokedCurveRound(State *state)
   cairo_rectangle(state->cr, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
   cairo_stroke(state->cr);
 
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
 }
 
 void drawing(State *state){
@@ -1230,23 +1331,35 @@ int main(int argc, char** argv)
   setTransform(&state);
   drawing(&state);
   drawInfoBox(&state);
+  presentFrame(&state.frame);
 
   SDL_Event event;
-  while(1){
-    if (SDL_PollEvent(&event)){
+  bool quit = false;
+  while(!quit){
+    /* Sleep until there is input, then step through everything queued and
+     * draw only the test it ends on. */
+    if (!SDL_WaitEventTimeout(&event, 1000))
+      continue;
+    bool moved = false;
+    do {
+      if (event.type == SDL_QUIT)
+      {
+        quit = true;
+        break;
+      }
       if (event.type == SDL_KEYDOWN)
       {
         SDL_KeyboardEvent ke = event.key;
         if(ke.keysym.scancode == 20)
+        {
+          quit = true;
           break;
+        }
         else if(ke.keysym.scancode == 79)
         {
           // right
           state.current_test = (state.current_test + 1) % state.total_tests;
-          clearCanvas(&state);
-          setTransform(&state);
-          drawing(&state);
-          drawInfoBox(&state);
+          moved = true;
         }
         else if(ke.keysym.scancode == 80)
         {
@@ -1254,15 +1367,20 @@ int main(int argc, char** argv)
           state.current_test -= 1;
           if (state.current_test < 0)
             state.current_test = state.total_tests - 1;
-          clearCanvas(&state);
-          setTransform(&state);
-          drawing(&state);
-          drawInfoBox(&state);
+          moved = true;
         }
         else
           printf("%d\n", ke.keysym.scancode);
       }
+    } while (SDL_PollEvent(&event));
+    if (moved)
+    {
+      clearCanvas(&state);
+      setTransform(&state);
+      drawing(&state);
+      drawInfoBox(&state);
     }
+    presentFrame(&state.frame);
   }
 
   cairo_destroy(state.cr);
@@ -1,10 +1,10 @@
 #include <iostream>
-#include <fstream>
 #include <memory>
 #include <cstring>
+#include <algorithm>
+#include <thread>
 
 #include <SDL2/SDL.h>
-#include <gdk-pixbuf/gdk-pixbuf.h>
 #include <cairo.h>
 #include <librsvg/rsvg.h>
 
@@ -18,8 +18,21 @@
 #include <core/SkCanvas.h>
 #include <src/core/SkRTree.h>
 #include <SkPictureRecorder.h>
+#include <core/SkPicture.h>
 #include <svgnative/ports/skia/SkiaSVGRenderer.h>
 
+#include "bbox.h"
+#include "ImageCacheSVGRenderer.h"
+#include "CullingSVGRenderer.h"
+#include "LodSVGRenderer.h"
+#include "svg-file.h"
+#include "tiles.h"
+#include "pixels.h"
+#include "frame.h"
+#include "render-worker.h"
+#include "timing.h"
+#include "trace.h"
+
 typedef enum _SVGRenderer {
   SNV = 0,
   LIBRSVG = 1
@@ -47,10 +60,69 @@ typedef struct _State {
   double scale_x;
   double scale_y;
   bool render_recording;
-  GdkPixbuf *pixbuf;
-  GdkPixbuf *saved_pixbuf;
+  /* The frame captured when freezing, with its mip levels. */
+  MipPyramid frozen;
   sk_sp<SkSurface> skSurface;
   SkCanvas* skCanvas;
+  /* Parsed documents, one per renderer/engine pair. They are kept across
+   * frames so that a transform change only re-renders. SNV documents are
+   * parsed through an image cache wrapper around the port, so embedded images
+   * are only decoded once they are on screen, and once per process. On top
+   * of that, a culling wrapper drops whatever is off screen when rendering
+   * directly to the window, and in LOD mode the outermost wrapper draws
+   * simplified paths for the current zoom. */
+  bool render_lod;
+  std::string loaded_filename;
+  std::shared_ptr<SVGNative::CairoSVGRenderer> snv_cairo_renderer;
+  std::shared_ptr<SVGNative::ImageCacheSVGRenderer> snv_cairo_images;
+  std::shared_ptr<SVGNative::CullingSVGRenderer> snv_cairo_cull;
+  std::shared_ptr<SVGNative::LodSVGRenderer> snv_cairo_lod;
+  std::unique_ptr<SVGNative::SVGDocument> snv_cairo_doc;
+  std::shared_ptr<SVGNative::SkiaSVGRenderer> snv_skia_renderer;
+  std::shared_ptr<SVGNative::ImageCacheSVGRenderer> snv_skia_images;
+  std::shared_ptr<SVGNative::CullingSVGRenderer> snv_skia_cull;
+  std::shared_ptr<SVGNative::LodSVGRenderer> snv_skia_lod;
+  std::unique_ptr<SVGNative::SVGDocument> snv_skia_doc;
+  RsvgHandle *rsvg_handle;
+  /* Retained display lists recorded in document space. In retained mode a
+   * transform change only replays these under the new matrix. */
+  bool render_retained;
+  cairo_surface_t *snv_cairo_recording;
+  std::vector<SVGNative::Rect> snv_cairo_boxes;
+  sk_sp<SkPicture> snv_skia_picture;
+  std::vector<SVGNative::Rect> snv_skia_boxes;
+  cairo_surface_t *rsvg_recording;
+  /* Tiled mode rasterizes the retained display list in parallel tiles. */
+  bool render_tiled;
+  TileCache tile_cache;
+  const void *tile_owner;
+  /* Everything drawn in a frame is presented once, at the end of it. */
+  Frame frame;
+  /* Async mode rasterizes on render_worker. Until the frame for the current
+   * view lands, the last completed one is shown scaled to it. */
+  bool render_async;
+  RenderWorker render_worker;
+  uint32_t render_event;
+  uint64_t render_generation;
+  bool has_shown_frame;
+  RenderFrame shown_frame;
+  MipPyramid shown_pyramid;
+  /* Where each frame's time goes, shown in the info box. */
+  StageTimings timings;
+  /* Raster ground truth box of the loaded file, drawn over the document. */
+  bool show_ground_truth;
+  BBoxWorker bbox_worker;
+  std::string ground_truth_filename;
+  int ground_truth_status;
+  double ground_truth[4];
+  /* Hover mode outlines the topmost element under the mouse, looked up in a
+   * spatial index of the geometry engine's boxes built once per file. */
+  bool show_hover;
+  SpatialIndex hover_index;
+  std::string hover_filename;
+  int mouse_x;
+  int mouse_y;
+  int hover_element;
 } State;
 
 typedef struct _Color {
@@ -84,11 +156,6 @@ int initialize(State *state, int width, int height) {
                                                              state->sdl_surface->w,
                                                              state->sdl_surface->h,
                                                              state->sdl_surface->pitch);
-  state->pixbuf = gdk_pixbuf_new_from_data((const unsigned char*)state->sdl_surface->pixels, GDK_COLORSPACE_RGB, true, 8, state->sdl_surface->w,
-                            state->sdl_surface->h, state->sdl_surface->pitch, NULL, NULL);
-  unsigned char* data = (unsigned char*)malloc(state->sdl_surface->h * state->sdl_surface->pitch);
-  state->saved_pixbuf = gdk_pixbuf_new_from_data((const unsigned char*)data, GDK_COLORSPACE_RGB, true, 8, state->sdl_surface->w,
-                                                 state->sdl_surface->h, state->sdl_surface->pitch, NULL, NULL);
   state->cr = cairo_create(state->cairo_surface);
 
   SkImageInfo skImageInfo = SkImageInfo::Make(state->width, state->height, kBGRA_8888_SkColorType, kOpaque_SkAlphaType, nullptr);
@@ -103,7 +170,9 @@ int initialize(State *state, int width, int height) {
   cairo_close_path(state->cr);
   cairo_fill(state->cr);
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  initializeFrame(&state->frame, state->window, state->sdl_surface->w, state->sdl_surface->h);
+  damageFrameAll(&state->frame);
+  presentFrame(&state->frame);
 
   return 0;
 }
@@ -119,16 +188,174 @@ void clearCanvas(State *state)
   cairo_close_path(state->cr);
   cairo_fill(state->cr);
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameAll(&state->frame);
+}
+
+void freeRecordings(State *state)
+{
+  if (state->snv_cairo_recording)
+    cairo_surface_destroy(state->snv_cairo_recording);
+  state->snv_cairo_recording = NULL;
+  state->snv_cairo_boxes.clear();
+  state->snv_skia_picture.reset();
+  state->snv_skia_boxes.clear();
+  if (state->rsvg_recording)
+    cairo_surface_destroy(state->rsvg_recording);
+  state->rsvg_recording = NULL;
+  clearTileCache(&state->tile_cache);
+  state->tile_owner = NULL;
+  /* A new recording could reuse the address the shown frame is keyed on. */
+  state->has_shown_frame = false;
+}
+
+void freeDocuments(State *state)
+{
+  freeRecordings(state);
+  state->snv_cairo_doc.reset();
+  state->snv_skia_doc.reset();
+  if (state->rsvg_handle)
+    g_object_unref(state->rsvg_handle);
+  state->rsvg_handle = NULL;
+  state->loaded_filename = "";
+}
+
+int readDocument(State *state, std::string filename, SVGFile *svg_file)
+{
+  beginStage(&state->timings, STAGE_READ);
+  int status = openSVGFile(filename, svg_file);
+  endStage(&state->timings);
+  return status;
+}
+
+/* Walks the document once with the geometry engine for the boxes and scales
+ * the culling and LOD wrappers need. */
+void prepareDraws(State *state, SVGFile *svg_file, SVGNative::CullingSVGRenderer *cull, SVGNative::LodSVGRenderer *lod)
+{
+  beginStage(&state->timings, STAGE_BBOX);
+  SVGNative::GeometrySVGRenderer *geometry = state->bbox_worker.geometry_renderer.get();
+  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_file->data, state->bbox_worker.geometry_renderer));
+  if (doc)
+  {
+    geometry->Reset(identityMatrix());
+    doc->Render();
+    cull->SetBounds(geometry->DrawBounds(), geometry->GroupBounds());
+    lod->SetDraws(geometry->DrawBounds(), geometry->DrawScales());
+  }
+  endStage(&state->timings);
+}
+
+/* Parses the document for the current renderer/engine pair unless it is
+ * already cached. Returns 0 if a document is ready to render. */
+int loadDocument(State *state, std::string filename)
+{
+  TRACE_SCOPE("loadDocument");
+  if (state->loaded_filename != filename)
+  {
+    freeDocuments(state);
+    state->loaded_filename = filename;
+  }
+
+  if (state->renderer == SNV && state->engine == CAIRO && !state->snv_cairo_doc)
+  {
+    SVGFile svg_file;
+    if (readDocument(state, filename, &svg_file))
+      return 1;
+    beginStage(&state->timings, STAGE_PARSE);
+    state->snv_cairo_renderer = std::make_shared<SVGNative::CairoSVGRenderer>();
+    state->snv_cairo_images = std::make_shared<SVGNative::ImageCacheSVGRenderer>(state->snv_cairo_renderer, SVGNative::sharedImageCache());
+    state->snv_cairo_cull = std::make_shared<SVGNative::CullingSVGRenderer>(state->snv_cairo_images);
+    state->snv_cairo_lod = std::make_shared<SVGNative::LodSVGRenderer>(state->snv_cairo_cull, state->render_lod);
+    state->snv_cairo_lod->SetCulling(state->snv_cairo_cull);
+    state->snv_cairo_doc.reset(SVGNative::SVGDocument::CreateSVGDocument(svg_file.data, state->snv_cairo_lod));
+    endStage(&state->timings);
+    prepareDraws(state, &svg_file, state->snv_cairo_cull.get(), state->snv_cairo_lod.get());
+    closeSVGFile(&svg_file);
+    return state->snv_cairo_doc ? 0 : 1;
+  }
+  else if (state->renderer == SNV && state->engine == SKIA && !state->snv_skia_doc)
+  {
+    SVGFile svg_file;
+    if (readDocument(state, filename, &svg_file))
+      return 1;
+    beginStage(&state->timings, STAGE_PARSE);
+    state->snv_skia_renderer = std::make_shared<SVGNative::SkiaSVGRenderer>();
+    state->snv_skia_images = std::make_shared<SVGNative::ImageCacheSVGRenderer>(state->snv_skia_renderer, SVGNative::sharedImageCache());
+    state->snv_skia_cull = std::make_shared<SVGNative::CullingSVGRenderer>(state->snv_skia_images);
+    state->snv_skia_lod = std::make_shared<SVGNative::LodSVGRenderer>(state->snv_skia_cull, state->render_lod);
+    state->snv_skia_lod->SetCulling(state->snv_skia_cull);
+    state->snv_skia_doc.reset(SVGNative::SVGDocument::CreateSVGDocument(svg_file.data, state->snv_skia_lod));
+    endStage(&state->timings);
+    prepareDraws(state, &svg_file, state->snv_skia_cull.get(), state->snv_skia_lod.get());
+    closeSVGFile(&svg_file);
+    return state->snv_skia_doc ? 0 : 1;
+  }
+  else if (state->renderer == LIBRSVG && !state->rsvg_handle)
+  {
+    GError *error = nullptr;
+    SVGFile svg_file;
+    if (readDocument(state, filename, &svg_file))
+      return 1;
+    beginStage(&state->timings, STAGE_PARSE);
+    state->rsvg_handle = rsvg_handle_new_from_data((const unsigned char*)svg_file.data, svg_file.size, &error);
+    endStage(&state->timings);
+    closeSVGFile(&svg_file);
+    if (error)
+    {
+      fprintf(stderr, "librsvg failed to parse %s: %s\n", filename.c_str(), error->message);
+      g_error_free(error);
+    }
+    return state->rsvg_handle ? 0 : 1;
+  }
+  return 0;
+}
+
+/* Whether an image area given in user space can touch the current clip,
+ * which on the window surface is at most the window. */
+bool cairoAreaVisible(cairo_t *cr, SVGNative::Rect const& area)
+{
+  double x0, y0, x1, y1;
+  cairo_clip_extents(cr, &x0, &y0, &x1, &y1);
+  return area.x < x1 && area.x + area.width > x0 && area.y < y1 && area.y + area.height > y0;
+}
+
+/* The document space area on screen, grown by two pixels for antialiasing
+ * and line joins the geometry boxes round off. */
+Box viewportBox(State *state)
+{
+  double width_box = state->x1 - state->x0 + 1;
+  double height_box = state->y1 - state->y0 + 1;
+  double pad_x = 2 * width_box / state->width;
+  double pad_y = 2 * height_box / state->height;
+  Box box = {state->x0 - pad_x, state->y0 - pad_y, state->x0 + width_box + pad_x, state->y0 + height_box + pad_y};
+  return box;
+}
+
+/* Device pixels per document unit, the larger of the two axes. */
+double viewScale(State *state)
+{
+  double width_box = state->x1 - state->x0 + 1;
+  double height_box = state->y1 - state->y0 + 1;
+  return std::max(state->width / width_box, state->height / height_box);
 }
 
-void drawSVGDocumentSNVCairo(State *state, std::string svg_doc)
+void drawSVGDocumentSNVCairo(State *state)
 {
-  auto renderer = std::make_shared<SVGNative::CairoSVGRenderer>();
-  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_doc.c_str(), renderer));
-  renderer->SetCairo(state->cr);
+  TRACE_SCOPE("drawSVGDocumentSNVCairo");
+  SVGNative::SVGDocument *doc = state->snv_cairo_doc.get();
+  state->snv_cairo_renderer->SetCairo(state->cr);
+  beginStage(&state->timings, STAGE_BBOX);
   std::vector<SVGNative::Rect> boxes = doc->Bounds();
+  endStage(&state->timings);
+  cairo_t *cr = state->cr;
+  state->snv_cairo_images->SetVisibleTest([cr](SVGNative::Rect const& area) { return cairoAreaVisible(cr, area); });
+  state->snv_cairo_cull->BeginCulling(viewportBox(state));
+  if (state->render_lod)
+    state->snv_cairo_lod->BeginLod(viewScale(state));
   doc->Render();
+  state->snv_cairo_lod->EndLod();
+  state->snv_cairo_cull->EndCulling();
+  state->snv_cairo_images->SetVisibleTest(nullptr);
+  beginStage(&state->timings, STAGE_OVERLAY);
   for(auto const& box: boxes) {
     cairo_new_path(state->cr);
     cairo_identity_matrix(state->cr);
@@ -138,17 +365,29 @@ void drawSVGDocumentSNVCairo(State *state, std::string svg_doc)
     cairo_stroke(state->cr);
     cairo_surface_flush(state->cairo_surface);
   }
+  endStage(&state->timings);
 }
 
-void drawSVGDocumentSNVSkia(State *state, std::string svg_doc)
+void drawSVGDocumentSNVSkia(State *state)
 {
-  auto renderer = std::make_shared<SVGNative::SkiaSVGRenderer>();
-
-  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_doc.c_str(), renderer));
-
-  renderer->SetSkCanvas(state->skCanvas);
+  TRACE_SCOPE("drawSVGDocumentSNVSkia");
+  SVGNative::SVGDocument *doc = state->snv_skia_doc.get();
+  state->snv_skia_renderer->SetSkCanvas(state->skCanvas);
+  SkCanvas *canvas = state->skCanvas;
+  state->snv_skia_images->SetVisibleTest([canvas](SVGNative::Rect const& area) {
+    return !canvas->quickReject(SkRect::MakeXYWH(area.x, area.y, area.width, area.height));
+  });
+  state->snv_skia_cull->BeginCulling(viewportBox(state));
+  if (state->render_lod)
+    state->snv_skia_lod->BeginLod(viewScale(state));
   doc->Render();
+  state->snv_skia_lod->EndLod();
+  state->snv_skia_cull->EndCulling();
+  state->snv_skia_images->SetVisibleTest(nullptr);
+  beginStage(&state->timings, STAGE_BBOX);
   std::vector<SVGNative::Rect> boxes = doc->Bounds();
+  endStage(&state->timings);
+  beginStage(&state->timings, STAGE_OVERLAY);
   for(auto const& box: boxes) {
     cairo_new_path(state->cr);
     cairo_identity_matrix(state->cr);
@@ -158,46 +397,253 @@ void drawSVGDocumentSNVSkia(State *state, std::string svg_doc)
     cairo_stroke(state->cr);
     cairo_surface_flush(state->cairo_surface);
   }
+  endStage(&state->timings);
 }
 
-void drawSVGDocumentSNV(State *state, std::string svg_doc)
+void drawSVGDocumentSNV(State *state)
 {
   if (state->engine == CAIRO)
   {
-    drawSVGDocumentSNVCairo(state, svg_doc);
+    drawSVGDocumentSNVCairo(state);
   }
   else if(state->engine == SKIA)
   {
-    drawSVGDocumentSNVSkia(state, svg_doc);
+    drawSVGDocumentSNVSkia(state);
   }
 }
 
-void drawSVGDocumentLibrsvg(State *state, std::string svg_doc)
+void drawSVGDocumentLibrsvg(State *state)
 {
-  GError *error = nullptr;
-  RsvgHandle *handle = rsvg_handle_new_from_data((const unsigned char*)svg_doc.c_str(), strlen(svg_doc.c_str()), &error);
-  rsvg_handle_render_cairo(handle, state->cr);
+  TRACE_SCOPE("drawSVGDocumentLibrsvg");
+  rsvg_handle_render_cairo(state->rsvg_handle, state->cr);
   cairo_surface_flush(state->cairo_surface);
 }
 
-void drawSVGDocument(State *state, std::string filename)
+/* Records the current renderer/engine pair into its display list unless it
+ * has already been recorded. Expects loadDocument() to have succeeded. */
+void recordDocument(State *state)
+{
+  TRACE_SCOPE("recordDocument");
+  if (state->renderer == SNV && state->engine == CAIRO && !state->snv_cairo_recording)
+  {
+    state->snv_cairo_recording = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, NULL);
+    cairo_t *ct = cairo_create(state->snv_cairo_recording);
+    state->snv_cairo_renderer->SetCairo(ct);
+    beginStage(&state->timings, STAGE_BBOX);
+    state->snv_cairo_boxes = state->snv_cairo_doc->Bounds();
+    endStage(&state->timings);
+    state->snv_cairo_doc->Render();
+    cairo_destroy(ct);
+    state->snv_cairo_renderer->SetCairo(state->cr);
+  }
+  else if (state->renderer == SNV && state->engine == SKIA && !state->snv_skia_picture)
+  {
+    SkRTreeFactory factory;
+    SkPictureRecorder skPictureRecorder;
+    SkRect cull = {-1000, -1000, 10000, 10000};
+    SkCanvas *canvas = skPictureRecorder.beginRecording(cull, factory());
+    state->snv_skia_renderer->SetSkCanvas(canvas);
+    state->snv_skia_doc->Render();
+    beginStage(&state->timings, STAGE_BBOX);
+    state->snv_skia_boxes = state->snv_skia_doc->Bounds();
+    endStage(&state->timings);
+    state->snv_skia_picture = skPictureRecorder.finishRecordingAsPicture();
+    state->snv_skia_renderer->SetSkCanvas(state->skCanvas);
+  }
+  else if (state->renderer == LIBRSVG && !state->rsvg_recording)
+  {
+    state->rsvg_recording = cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA, NULL);
+    cairo_t *ct = cairo_create(state->rsvg_recording);
+    rsvg_handle_render_cairo(state->rsvg_handle, ct);
+    cairo_destroy(ct);
+  }
+}
+
+/* Strokes boxes given in document space with a one pixel wide line. */
+void drawRetainedBoxes(State *state, std::vector<SVGNative::Rect> const& boxes)
+{
+  beginStage(&state->timings, STAGE_OVERLAY);
+  for(auto const& box: boxes) {
+    cairo_save(state->cr);
+    cairo_new_path(state->cr);
+    cairo_rectangle(state->cr, box.x, box.y, box.width, box.height);
+    cairo_identity_matrix(state->cr);
+    cairo_set_source_rgb(state->cr, 1.0, 0.0, 0.0);
+    cairo_set_line_width(state->cr, 1.0);
+    cairo_stroke(state->cr);
+    cairo_restore(state->cr);
+  }
+  cairo_surface_flush(state->cairo_surface);
+  endStage(&state->timings);
+}
+
+/* Replays the recorded display list under the matrix set by setTransform().
+ * Skia culls recorded ops against the canvas clip through the picture's
+ * R-tree, and Cairo does the same with the recording surface's own bbtree. */
+void drawSVGDocumentRetained(State *state)
 {
-  std::ifstream svg_file(filename);
+  TRACE_SCOPE("drawSVGDocumentRetained");
+  recordDocument(state);
+  if (state->renderer == SNV && state->engine == CAIRO)
+  {
+    cairo_set_source_surface(state->cr, state->snv_cairo_recording, 0, 0);
+    cairo_paint(state->cr);
+    cairo_surface_flush(state->cairo_surface);
+    drawRetainedBoxes(state, state->snv_cairo_boxes);
+  }
+  else if (state->renderer == SNV && state->engine == SKIA)
+  {
+    state->skCanvas->drawPicture(state->snv_skia_picture);
+    drawRetainedBoxes(state, state->snv_skia_boxes);
+  }
+  else if (state->renderer == LIBRSVG)
+  {
+    cairo_set_source_surface(state->cr, state->rsvg_recording, 0, 0);
+    cairo_paint(state->cr);
+    cairo_surface_flush(state->cairo_surface);
+  }
+}
 
-  std::string svg_doc = "";
-  std::string line;
+/* Like drawSVGDocumentRetained() but the recording is rasterized in tiles
+ * that are cached across frames, so a pan only renders the exposed strips. */
+void drawSVGDocumentTiled(State *state)
+{
+  TRACE_SCOPE("drawSVGDocumentTiled");
+  recordDocument(state);
+  TileSource source;
+  source.cairo_recording = NULL;
+  std::vector<SVGNative::Rect> *boxes = NULL;
+  if (state->renderer == SNV && state->engine == CAIRO)
+  {
+    source.cairo_recording = state->snv_cairo_recording;
+    boxes = &state->snv_cairo_boxes;
+  }
+  else if (state->renderer == SNV && state->engine == SKIA)
+  {
+    source.skia_picture = state->snv_skia_picture;
+    boxes = &state->snv_skia_boxes;
+  }
+  else
+    source.cairo_recording = state->rsvg_recording;
 
-  while (std::getline(svg_file, line)) {
-    svg_doc += line;
+  /* Tiles are only valid for the recording they were rendered from. */
+  const void *owner = source.cairo_recording ? (const void*)source.cairo_recording : (const void*)source.skia_picture.get();
+  if (owner != state->tile_owner)
+  {
+    clearTileCache(&state->tile_cache);
+    state->tile_owner = owner;
   }
 
-  if (state->renderer == SNV)
-    drawSVGDocumentSNV(state, svg_doc);
+  double scale = state->width / (state->x1 - state->x0 + 1);
+  drawTiles(&state->tile_cache, &source, state->x0, state->y0, scale,
+            (unsigned char*)state->sdl_surface->pixels, state->width, state->height, state->sdl_surface->pitch);
+  cairo_surface_mark_dirty(state->cairo_surface);
+  if (boxes)
+    drawRetainedBoxes(state, *boxes);
+}
+
+bool sameView(RenderView const& a, RenderView const& b)
+{
+  return a.owner == b.owner && a.x0 == b.x0 && a.y0 == b.y0 && a.scale_x == b.scale_x && a.scale_y == b.scale_y &&
+         a.width == b.width && a.height == b.height;
+}
+
+void drawSVGDocumentAsync(State *state)
+{
+  TRACE_SCOPE("drawSVGDocumentAsync");
+  recordDocument(state);
+  TileSource source;
+  source.cairo_recording = NULL;
+  std::vector<SVGNative::Rect> *boxes = NULL;
+  if (state->renderer == SNV && state->engine == CAIRO)
+  {
+    source.cairo_recording = state->snv_cairo_recording;
+    boxes = &state->snv_cairo_boxes;
+  }
+  else if (state->renderer == SNV && state->engine == SKIA)
+  {
+    source.skia_picture = state->snv_skia_picture;
+    boxes = &state->snv_skia_boxes;
+  }
+  else
+    source.cairo_recording = state->rsvg_recording;
+
+  RenderView view;
+  view.owner = source.cairo_recording ? (const void*)source.cairo_recording : (const void*)source.skia_picture.get();
+  view.x0 = state->x0;
+  view.y0 = state->y0;
+  view.scale_x = state->width / (state->x1 - state->x0 + 1);
+  view.scale_y = state->height / (state->y1 - state->y0 + 1);
+  view.width = state->sdl_surface->w;
+  view.height = state->sdl_surface->h;
+
+  unsigned char *pixels = (unsigned char*)state->sdl_surface->pixels;
+  int pitch = state->sdl_surface->pitch;
+  RenderView const& shown = state->shown_frame.view;
+  if (state->has_shown_frame && sameView(shown, view))
+  {
+    /* Back on the view already shown, so a job still running is for a view
+     * that has been left. */
+    if (state->render_generation != state->shown_frame.generation)
+    {
+      cancelRenderJob(&state->render_worker);
+      state->render_generation = state->shown_frame.generation;
+    }
+    for (int y = 0; y < view.height; y++)
+      memcpy(pixels + (size_t)y * pitch, state->shown_frame.pixels.data() + (size_t)y * view.width, view.width * 4);
+  }
+  else
+  {
+    /* Stretch the last frame of the same document over the new view, then
+     * ask for the sharp one. */
+    if (state->has_shown_frame && shown.owner == view.owner)
+      sampleMipPyramid(&state->shown_pyramid, (view.x0 - shown.x0) * shown.scale_x, (view.y0 - shown.y0) * shown.scale_y,
+                       view.scale_x / shown.scale_x, view.scale_y / shown.scale_y, pixels, pitch, view.width, view.height);
+    state->render_generation = submitRenderJob(&state->render_worker, &source, view);
+  }
+  cairo_surface_mark_dirty(state->cairo_surface);
+  if (boxes)
+    drawRetainedBoxes(state, *boxes);
+}
+
+/* Keeps a frame the worker finished if it is still the latest one asked
+ * for. Returns true when the view should be redrawn with it. */
+bool acceptRenderFrame(State *state)
+{
+  RenderFrame frame;
+  if (!takeRenderFrame(&state->render_worker, &frame) || frame.generation != state->render_generation)
+    return false;
+  std::swap(state->shown_frame, frame);
+  state->has_shown_frame = true;
+  buildMipPyramid(&state->shown_pyramid, (const unsigned char*)state->shown_frame.pixels.data(),
+                  state->shown_frame.view.width * 4, state->shown_frame.view.width, state->shown_frame.view.height);
+  return state->render_async && !state->render_recording;
+}
+
+void drawSVGDocument(State *state, std::string filename)
+{
+  /* Reading, parsing, bbox and overlay work below open their own stages,
+   * so only the rasterization itself stays charged to render. */
+  beginStage(&state->timings, STAGE_RENDER);
+  if (loadDocument(state, filename))
+  {
+    endStage(&state->timings);
+    return;
+  }
+
+  if (state->render_async)
+    drawSVGDocumentAsync(state);
+  else if (state->render_tiled)
+    drawSVGDocumentTiled(state);
+  else if (state->render_retained)
+    drawSVGDocumentRetained(state);
+  else if (state->renderer == SNV)
+    drawSVGDocumentSNV(state);
   else if(state->renderer == LIBRSVG)
-    drawSVGDocumentLibrsvg(state, svg_doc);
+    drawSVGDocumentLibrsvg(state);
 
-  svg_file.close();
-  SDL_UpdateWindowSurface(state->window);
+  endStage(&state->timings);
+  damageFrameAll(&state->frame);
 }
 
 void drawRectangle(State *state, double x0, double y0, double x1, double y1, Color color) {
@@ -210,7 +656,8 @@ void drawRectangle(State *state, double x0, double y0, double x1, double y1, Col
   cairo_close_path(state->cr);
   cairo_stroke(state->cr);
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  damageFrameUserBox(&state->frame, state->cr, std::min(x0, x1) - 0.25, std::min(y0, y1) - 0.25,
+                     std::max(x0, x1) + 0.25, std::max(y0, y1) + 0.25, 1);
 }
 
 void zoomInTransform(State *state)
@@ -277,14 +724,24 @@ void moveTransform(State *state, int x, int y)
   }
 }
 
+/* Document units to window pixels for the current viewbox. */
+void viewMatrix(State *state, cairo_matrix_t *matrix)
+{
+  double width_box = state->x1 - state->x0 + 1;
+  double height_box = state->y1 - state->y0 + 1;
+  cairo_matrix_init_scale(matrix, state->width/width_box, state->height/height_box);
+  cairo_matrix_translate(matrix, -1 * state->x0, -1 * state->y0);
+}
+
 void setTransform(State *state)
 {
   double width_box = state->x1 - state->x0 + 1;
   double height_box = state->y1 - state->y0 + 1;
   double scale_x = state->width/width_box;
   double scale_y = state->height/height_box;
-  cairo_scale(state->cr, scale_x, scale_y);
-  cairo_translate(state->cr, -1 * state->x0, -1 * state->y0);
+  cairo_matrix_t matrix;
+  viewMatrix(state, &matrix);
+  cairo_transform(state->cr, &matrix);
   state->skCanvas->resetMatrix();
   state->skCanvas->scale(scale_x, scale_y);
   state->skCanvas->translate(-1 * state->x0, -1 * state->y0);
@@ -296,63 +753,13 @@ void drawRecording(State *state)
   double height_box = state->y1 - state->y0 + 1;
   double scale_x = state->width/width_box;
   double scale_y = state->height/height_box;
-  gdk_pixbuf_scale(state->saved_pixbuf, state->pixbuf, 0, 0, state->width, state->height, -1 * state->x0 * scale_x, -1 * state->y0 * scale_y, scale_x, scale_y, GDK_INTERP_NEAREST);
-  SDL_UpdateWindowSurface(state->window);
-}
-
-void calculateBoundingBoxCairo(std::string filename, double *x0, double *y0, double *width, double *height)
-{
-  cairo_surface_t *recording_surface = cairo_recording_surface_create(CAIRO_CONTENT_COLOR, NULL);
-  cairo_t* ct = cairo_create(recording_surface);
-
-  auto renderer = std::make_shared<SVGNative::CairoSVGRenderer>();
-
-  std::ifstream svg_file(filename);
-
-  std::string svg_doc = "";
-  std::string line;
-  while (std::getline(svg_file, line)) {
-    svg_doc += line;
-  }
-
-  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_doc.c_str(), renderer));
-  renderer->SetCairo(ct);
-  doc->Render();
-
-  cairo_recording_surface_ink_extents(recording_surface, x0, y0, width, height);
-  cairo_destroy(ct);
-  cairo_surface_flush(recording_surface);
-  cairo_surface_destroy(recording_surface);
-}
-
-void calculateBoundingBoxSkia(std::string filename, double *x0, double *y0, double *width, double *height)
-{
-  std::ifstream svg_file(filename);
-  std::string svg_doc = "";
-  std::string line;
-  while (std::getline(svg_file, line)) {
-    svg_doc += line;
-  }
-
-  SkRTreeFactory factory;
-  SkPictureRecorder skPictureRecorder;
-  SkRect cull = {-1000, -1000, 10000, 10000};
-  sk_sp<SkBBoxHierarchy> bbh = factory();
-  SkCanvas *canvas = skPictureRecorder.beginRecording(cull, bbh);
-
-  auto renderer = std::make_shared<SVGNative::SkiaSVGRenderer>();
-  auto doc = std::unique_ptr<SVGNative::SVGDocument>(SVGNative::SVGDocument::CreateSVGDocument(svg_doc.c_str(), renderer));
-  renderer->SetSkCanvas(canvas);
-  doc->Render();
-
-  SkRect rect;
-  sk_sp<SkPicture> pic = skPictureRecorder.finishRecordingAsPicture();
-  rect = pic->cullRect();
-
-  *x0 = rect.x();
-  *y0 = rect.y();
-  *width = rect.width();
-  *height = rect.height();
+  beginStage(&state->timings, STAGE_RENDER);
+  cairo_surface_flush(state->cairo_surface);
+  sampleMipPyramid(&state->frozen, state->x0, state->y0, scale_x, scale_y, (unsigned char*)state->sdl_surface->pixels,
+                   state->sdl_surface->pitch, state->sdl_surface->w, state->sdl_surface->h);
+  cairo_surface_mark_dirty(state->cairo_surface);
+  endStage(&state->timings);
+  damageFrameAll(&state->frame);
 }
 
 void calculateBoundingBox(std::string filename, double *x0, double *y0, double *width, double *height)
@@ -363,6 +770,7 @@ void calculateBoundingBox(std::string filename, double *x0, double *y0, double *
 
 void drawInfoBox(State *state)
 {
+  beginStage(&state->timings, STAGE_OVERLAY);
   cairo_save(state->cr);
   cairo_identity_matrix(state->cr);
   cairo_set_source_rgb(state->cr, 0, 0, 0);
@@ -374,8 +782,15 @@ void drawInfoBox(State *state)
   cairo_show_text(state->cr, characters);
   if (state->render_recording)
     sprintf(characters, "Rendering Mode: Raster (frozen)");
+  else if (state->render_async)
+    sprintf(characters, "Rendering Mode: Vector (async, generation %lu%s)", (unsigned long)state->render_generation,
+            state->has_shown_frame && state->shown_frame.generation == state->render_generation ? "" : ", rendering");
+  else if (state->render_tiled)
+    sprintf(characters, "Rendering Mode: Vector (tiled, %d tiles rendered)", state->tile_cache.rendered);
+  else if (state->render_retained)
+    sprintf(characters, "Rendering Mode: Vector (retained)");
   else
-    sprintf(characters, "Rendering Mode: Vector");
+    sprintf(characters, "Rendering Mode: Vector%s", state->render_lod ? " (LOD)" : "");
   cairo_move_to(state->cr, 10, 35);
   cairo_show_text(state->cr, characters);
 
@@ -400,10 +815,169 @@ void drawInfoBox(State *state)
     cairo_show_text(state->cr, characters);
   }
 
+  /* The present of the frame being drawn hasn't happened yet, so this is
+   * the previous one. */
+  sprintf(characters, "Present: %.2f ms (%d rects), average %.2f ms over %lu frames", state->frame.present_ms,
+          state->frame.present_rects, state->frame.frames ? state->frame.total_present_ms / state->frame.frames : 0.0,
+          (unsigned long)state->frame.frames);
+  cairo_move_to(state->cr, 10, 95);
+  cairo_show_text(state->cr, characters);
+
+  /* Rolling statistics over the last TIMING_WINDOW frames, in ms. */
+  const char *rows[2] = {"avg", "p95"};
+  for (int r = 0; r < 2; r++)
+  {
+    int length = sprintf(characters, "Stages %s:", rows[r]);
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+      double ms = r == 0 ? stageAverage(&state->timings, (Stage)stage) : stageP95(&state->timings, (Stage)stage);
+      length += sprintf(characters + length, "  %s %.2f", stageName((Stage)stage), ms);
+    }
+    cairo_move_to(state->cr, 10, 110 + 15 * r);
+    cairo_show_text(state->cr, characters);
+  }
 
   cairo_surface_flush(state->cairo_surface);
-  SDL_UpdateWindowSurface(state->window);
+  damageFrame(&state->frame, 0, 0, state->width, 130);
+  cairo_restore(state->cr);
+  endStage(&state->timings);
+}
+
+/* Renderer, engine and mode of the current frame, for the timings CSV. */
+std::string frameLabel(State *state)
+{
+  std::string label = state->renderer == LIBRSVG ? "librsvg" : (state->engine == CAIRO ? "snv-cairo" : "snv-skia");
+  if (state->render_recording)
+    label += "-frozen";
+  else if (state->render_async)
+    label += "-async";
+  else if (state->render_tiled)
+    label += "-tiled";
+  else if (state->render_retained)
+    label += "-retained";
+  return label;
+}
+
+/* Presents the frame and closes its timings. */
+void finishFrame(State *state)
+{
+  uint64_t presented = state->frame.frames;
+  presentFrame(&state->frame);
+  if (state->frame.frames == presented)
+    return;
+  addStageTime(&state->timings, STAGE_PRESENT, state->frame.present_ms);
+  finishTimedFrame(&state->timings, frameLabel(state).c_str());
+}
+
+/* Draws the ink bounds found by scanning rendered pixels, computed once per
+ * file, so the engines' red boxes can be checked against them. */
+void drawGroundTruth(State *state, std::string filename)
+{
+  TRACE_SCOPE("drawGroundTruth");
+  if (state->ground_truth_filename != filename)
+  {
+    double *box = state->ground_truth;
+    beginStage(&state->timings, STAGE_BBOX);
+    state->ground_truth_status = calculateBoundingBox(&state->bbox_worker, BBOX_RASTER, filename,
+                                                      &box[0], &box[1], &box[2], &box[3]);
+    endStage(&state->timings);
+    state->ground_truth_filename = filename;
+  }
+  if (state->ground_truth_status != 0)
+    return;
+  double *box = state->ground_truth;
+  Color green = {0.0, 0.7, 0.0};
+  /* The overlays before this one may have left cairo at identity. */
+  cairo_matrix_t matrix;
+  viewMatrix(state, &matrix);
+  beginStage(&state->timings, STAGE_OVERLAY);
+  cairo_save(state->cr);
+  cairo_set_matrix(state->cr, &matrix);
+  drawRectangle(state, box[0], box[1], box[0] + box[2], box[1] + box[3], green);
+  cairo_restore(state->cr);
+  endStage(&state->timings);
+}
+
+/* The element under the mouse, or NULL. The mouse goes through the inverse
+ * of the matrix drawHover() draws with, so the hit and the box agree. */
+const IndexedElement *hoverElement(State *state)
+{
+  cairo_matrix_t matrix;
+  viewMatrix(state, &matrix);
+  if (cairo_matrix_invert(&matrix) != CAIRO_STATUS_SUCCESS)
+    return NULL;
+  Point p = {(double)state->mouse_x, (double)state->mouse_y};
+  cairo_matrix_transform_point(&matrix, &p.x, &p.y);
+  return hitTestSpatialIndex(&state->hover_index, p);
+}
+
+void drawHover(State *state, std::string filename)
+{
+  TRACE_SCOPE("drawHover");
+  if (state->hover_filename != filename)
+  {
+    SVGFile svg_file;
+    beginStage(&state->timings, STAGE_BBOX);
+    if (openSVGFile(filename, &svg_file) == 0)
+    {
+      buildElementIndex(&state->bbox_worker, &svg_file, &state->hover_index);
+      closeSVGFile(&svg_file);
+    }
+    else
+      clearSpatialIndex(&state->hover_index);
+    endStage(&state->timings);
+    state->hover_filename = filename;
+  }
+  const IndexedElement *element = hoverElement(state);
+  state->hover_element = element ? (int)element->order : -1;
+  if (!element)
+    return;
+  Color blue = {0.0, 0.3, 1.0};
+  cairo_matrix_t matrix;
+  viewMatrix(state, &matrix);
+  beginStage(&state->timings, STAGE_OVERLAY);
+  cairo_save(state->cr);
+  cairo_set_matrix(state->cr, &matrix);
+  drawRectangle(state, element->box.x0, element->box.y0, element->box.x1, element->box.y1, blue);
   cairo_restore(state->cr);
+  endStage(&state->timings);
+}
+
+void drawing(State *state, std::string filename);
+
+/* Draws the current view from scratch, frozen or not. */
+void redraw(State *state)
+{
+  clearCanvas(state);
+  setTransform(state);
+  if (state->render_recording)
+    drawRecording(state);
+  else
+    drawing(state, state->filename);
+  drawInfoBox(state);
+}
+
+/* Applies one navigation key to the viewbox without drawing anything.
+ * Returns false for keys that aren't navigation. */
+bool navigationStep(State *state, int scancode)
+{
+  if (scancode == 87)
+    zoomInTransform(state);
+  else if (scancode == 86)
+    zoomOutTransform(state);
+  else if (scancode == 82)
+    moveTransform(state, 0, -1);
+  else if (scancode == 80)
+    moveTransform(state, -1, 0);
+  else if (scancode == 81)
+    moveTransform(state, 0, 1);
+  else if (scancode == 79)
+    moveTransform(state, 1, 0);
+  else if (scancode == 98)
+    resetTransform(state);
+  else
+    return false;
+  return true;
 }
 
 void drawing(State *state, std::string filename){
@@ -412,13 +986,20 @@ void drawing(State *state, std::string filename){
   x1 = x0 + width - 1;
   y1 = y0 + height - 1;
   drawSVGDocument(state, filename);
+  if (state->show_ground_truth)
+    drawGroundTruth(state, filename);
+  if (state->show_hover)
+    drawHover(state, filename);
 }
 
 
 int main(int argc, char** argv)
 {
-  if (argc != 2)
+  if (argc < 2 || argc > 3)
+  {
+    fprintf(stderr, "usage: %s <file.svg> [timings.csv]\n", argv[0]);
     return 1;
+  }
 
   int width = 1000;
   int height = 1000;
@@ -436,115 +1017,98 @@ int main(int argc, char** argv)
   state.filename = std::string(argv[1]);
   state.renderer = SNV;
   state.engine = CAIRO;
+  state.rsvg_handle = NULL;
+  state.render_retained = false;
+  state.snv_cairo_recording = NULL;
+  state.rsvg_recording = NULL;
+  state.render_tiled = false;
+  state.render_async = false;
+  state.render_generation = 0;
+  state.has_shown_frame = false;
+  initializeStageTimings(&state.timings, argc > 2 ? argv[2] : NULL);
+  /* SVG_TRACE=<file.json> records a Chrome trace of the session. */
+  traceInitialize(getenv("SVG_TRACE"));
+  traceSetThreadName("ui");
+  state.tile_owner = NULL;
+  state.show_ground_truth = false;
+  state.show_hover = false;
+  state.render_lod = false;
+  state.mouse_x = 0;
+  state.mouse_y = 0;
+  state.hover_element = -1;
+  initializeBBoxWorker(&state.bbox_worker);
+  initializeTileCache(&state.tile_cache, 192, std::thread::hardware_concurrency());
 
   if (initialize(&state, width, height))
     return 1;
+  state.render_event = SDL_RegisterEvents(1);
+  startRenderWorker(&state.render_worker, state.render_event);
 
   clearCanvas(&state);
   setTransform(&state);
   drawing(&state, std::string(argv[1]));
   drawInfoBox(&state);
+  finishFrame(&state);
 
   SDL_Event event;
-  while(1){
-    if (SDL_PollEvent(&event)){
-      if (event.type == SDL_KEYDOWN)
+  bool quit = false;
+  while(!quit){
+    /* Sleep until there is input. Everything queued by then is handled in
+     * one go: navigation keys only step the viewbox, and the view is drawn
+     * once for the net transform. */
+    if (!SDL_WaitEventTimeout(&event, 1000))
+      continue;
+    bool redraw_pending = false;
+    do {
+      if (event.type == SDL_QUIT)
       {
-        SDL_KeyboardEvent ke = event.key;
-        if(ke.keysym.scancode == 20)
-          break;
-        else if(ke.keysym.scancode == 87)
-        {
-          clearCanvas(&state);
-          zoomInTransform(&state);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
-        }
-        else if(ke.keysym.scancode == 86)
+        quit = true;
+        break;
+      }
+      /* A finished async frame is drawn along with any pending navigation. */
+      if (event.type == state.render_event && acceptRenderFrame(&state))
+        redraw_pending = true;
+      /* Only a change of the hovered element needs a new frame. */
+      if (event.type == SDL_MOUSEMOTION)
+      {
+        state.mouse_x = event.motion.x;
+        state.mouse_y = event.motion.y;
+        if (state.show_hover && !state.render_recording)
         {
-          clearCanvas(&state);
-          zoomOutTransform(&state);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
+          const IndexedElement *element = hoverElement(&state);
+          if ((element ? (int)element->order : -1) != state.hover_element)
+            redraw_pending = true;
         }
-        else if(ke.keysym.scancode == 82)
-        {
-          /* up */
-          clearCanvas(&state);
-          moveTransform(&state, 0, -1);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
-        }
-        else if(ke.keysym.scancode == 80)
+      }
+      if (event.type == SDL_KEYDOWN)
+      {
+        SDL_KeyboardEvent ke = event.key;
+        if (navigationStep(&state, ke.keysym.scancode))
         {
-          /* left */
-          clearCanvas(&state);
-          moveTransform(&state, -1, 0);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
+          redraw_pending = true;
+          continue;
         }
-        else if(ke.keysym.scancode == 81)
+        /* Other keys act on the view as navigated so far. */
+        if (redraw_pending)
         {
-          /* down */
-          clearCanvas(&state);
-          moveTransform(&state, 0, 1);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
+          redraw(&state);
+          redraw_pending = false;
         }
-        else if(ke.keysym.scancode == 79)
+        if(ke.keysym.scancode == 20)
         {
-          /* right */
-          clearCanvas(&state);
-          moveTransform(&state, 1, 0);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
+          quit = true;
+          break;
         }
         else if(ke.keysym.scancode == 15)
         {
           clearCanvas(&state);
           setTransform(&state);
           drawing(&state, std::string(argv[1]));
-          unsigned char* c_data = cairo_image_surface_get_data(state.cairo_surface);
-          int c_width = cairo_image_surface_get_width(state.cairo_surface);
-          int c_height = cairo_image_surface_get_height(state.cairo_surface);
-          int c_pitch = cairo_image_surface_get_stride(state.cairo_surface);
-          int c_offset = c_pitch / c_width;
-          unsigned char* g_data = gdk_pixbuf_get_pixels(state.saved_pixbuf);
-          int g_width = gdk_pixbuf_get_width(state.saved_pixbuf);
-          int g_height = gdk_pixbuf_get_height(state.saved_pixbuf);
-          int g_pitch = gdk_pixbuf_get_rowstride(state.saved_pixbuf);
-          int g_offset = g_pitch / g_width;
-          for(int i = 0; i < c_height; i++) {
-            for(int j = 0; j < c_width; j++){
-              *(g_data + (i * g_pitch) + j*g_offset) = *(c_data + (i * c_pitch) + j*4);
-              *(g_data + (i * g_pitch) + j*g_offset + 1) = *(c_data + (i * c_pitch) + j*4 + 1);
-              *(g_data + (i * g_pitch) + j*g_offset + 2) = *(c_data + (i * c_pitch) + j*4 + 2);
-            }
-          }
+          /* Zooming the frozen frame samples these levels instead of
+           * scaling the whole frame every time. */
+          cairo_surface_flush(state.cairo_surface);
+          buildMipPyramid(&state.frozen, cairo_image_surface_get_data(state.cairo_surface), cairo_image_surface_get_stride(state.cairo_surface),
+                          cairo_image_surface_get_width(state.cairo_surface), cairo_image_surface_get_height(state.cairo_surface));
           state.render_recording = true;
           state.x0 = 0;
           state.y0 = 0;
@@ -567,42 +1131,61 @@ int main(int argc, char** argv)
           drawing(&state, std::string(argv[1]));
           drawInfoBox(&state);
         }
-        else if(ke.keysym.scancode == 98)
-        {
-          clearCanvas(&state);
-          resetTransform(&state);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
-        }
         else if(ke.keysym.scancode == 21)
         {
           if (state.renderer == SNV)
             state.renderer = LIBRSVG;
           else
             state.renderer = SNV;
-          clearCanvas(&state);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
+          redraw(&state);
         }
         else if(ke.keysym.scancode == 23)
         {
           if (state.renderer == SNV)
             state.engine = state.engine == CAIRO ? SKIA : CAIRO;
-          clearCanvas(&state);
-          setTransform(&state);
-          if (state.render_recording)
-            drawRecording(&state);
-          else
-            drawing(&state, std::string(argv[1]));
-          drawInfoBox(&state);
+          redraw(&state);
+        }
+        else if(ke.keysym.scancode == 25)
+        {
+          /* v: toggle retained display list replay */
+          state.render_retained = !state.render_retained;
+          redraw(&state);
+        }
+        else if(ke.keysym.scancode == 10)
+        {
+          /* g: toggle tiled parallel rasterization */
+          state.render_tiled = !state.render_tiled;
+          redraw(&state);
+        }
+        else if(ke.keysym.scancode == 4)
+        {
+          /* a: toggle rendering on the background worker */
+          state.render_async = !state.render_async;
+          redraw(&state);
+        }
+        else if(ke.keysym.scancode == 5)
+        {
+          /* b: toggle the raster ground truth box */
+          state.show_ground_truth = !state.show_ground_truth;
+          redraw(&state);
+        }
+        else if(ke.keysym.scancode == 11)
+        {
+          /* h: toggle hover highlighting */
+          state.show_hover = !state.show_hover;
+          redraw(&state);
+        }
+        else if(ke.keysym.scancode == 18)
+        {
+          /* o: toggle level of detail simplification. Paths only keep the
+           * geometry it needs when parsed with it on, so the first time
+           * SNV documents are parsed again. */
+          state.render_lod = !state.render_lod;
+          if (state.render_lod && state.snv_cairo_lod && !state.snv_cairo_lod->Enabled())
+            state.snv_cairo_doc.reset();
+          if (state.render_lod && state.snv_skia_lod && !state.snv_skia_lod->Enabled())
+            state.snv_skia_doc.reset();
+          redraw(&state);
         }
         else if(ke.keysym.scancode == 22)
         {
@@ -612,9 +1195,17 @@ int main(int argc, char** argv)
         else
           printf("%d\n", ke.keysym.scancode);
       }
-    }
+    } while (SDL_PollEvent(&event));
+    if (redraw_pending)
+      redraw(&state);
+    finishFrame(&state);
   }
 
+  stopRenderWorker(&state.render_worker);
+  destroyTileCache(&state.tile_cache);
+  closeStageTimings(&state.timings);
+  traceFlush();
+  freeDocuments(&state);
   cairo_destroy(state.cr);
   cairo_surface_destroy(state.cairo_surface);
   SDL_DestroyWindow(state.window);
@@ -0,0 +1,298 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXELS_X86 1
+#endif
+
+#include "pixels.h"
+
+#define ALPHA_MASK 0xff000000u
+
+typedef void (*RowKernel)(uint32_t *dst, const uint32_t *src, int width);
+
+static void opaqueRowScalar(uint32_t *dst, const uint32_t *src, int width)
+{
+  for (int x = 0; x < width; x++)
+    dst[x] = src[x] | ALPHA_MASK;
+}
+
+#ifdef PIXELS_X86
+static void opaqueRowSSE2(uint32_t *dst, const uint32_t *src, int width)
+{
+  const __m128i mask = _mm_set1_epi32((int)ALPHA_MASK);
+  int x = 0;
+  for (; x + 4 <= width; x += 4)
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_loadu_si128((const __m128i*)(src + x)), mask));
+  opaqueRowScalar(dst + x, src + x, width - x);
+}
+
+__attribute__((target("avx2")))
+static void opaqueRowAVX2(uint32_t *dst, const uint32_t *src, int width)
+{
+  const __m256i mask = _mm256_set1_epi32((int)ALPHA_MASK);
+  int x = 0;
+  for (; x + 8 <= width; x += 8)
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(src + x)), mask));
+  opaqueRowScalar(dst + x, src + x, width - x);
+}
+#endif
+
+static RowKernel selectRowKernel()
+{
+#ifdef PIXELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return opaqueRowAVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return opaqueRowSSE2;
+#endif
+  return opaqueRowScalar;
+}
+
+void copyPixelsOpaque(unsigned char *dst, int dst_pitch, const unsigned char *src, int src_pitch, int width, int height)
+{
+  static const RowKernel kernel = selectRowKernel();
+
+  /* Tightly packed buffers are one long row. */
+  if (dst_pitch == width * 4 && src_pitch == width * 4)
+  {
+    width *= height;
+    height = 1;
+  }
+  for (int y = 0; y < height; y++)
+    kernel((uint32_t*)(dst + (size_t)y * dst_pitch), (const uint32_t*)(src + (size_t)y * src_pitch), width);
+}
+
+/* Average of two rows of `width` pixels each, two by two, into `width / 2`
+ * pixels. */
+typedef void (*HalveKernel)(uint32_t *dst, const uint32_t *top, const uint32_t *bottom, int width);
+
+static uint32_t average4(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+  uint32_t result = 0;
+  for (int shift = 0; shift < 32; shift += 8)
+  {
+    uint32_t sum = ((a >> shift) & 0xff) + ((b >> shift) & 0xff) + ((c >> shift) & 0xff) + ((d >> shift) & 0xff);
+    result |= ((sum + 2) >> 2) << shift;
+  }
+  return result;
+}
+
+static void halveRowScalar(uint32_t *dst, const uint32_t *top, const uint32_t *bottom, int width)
+{
+  for (int x = 0; x + 1 < width; x += 2)
+    dst[x / 2] = average4(top[x], top[x + 1], bottom[x], bottom[x + 1]);
+}
+
+#ifdef PIXELS_X86
+/* Four output pixels per step: rows are averaged first, then even and odd
+ * pixels are split apart and averaged. _mm_avg_epu8 rounds up at both steps,
+ * which is at most one level off the exact mean. */
+static void halveRowSSE2(uint32_t *dst, const uint32_t *top, const uint32_t *bottom, int width)
+{
+  int x = 0;
+  for (; x + 8 <= width; x += 8)
+  {
+    __m128i v0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(top + x)), _mm_loadu_si128((const __m128i*)(bottom + x)));
+    __m128i v1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(top + x + 4)), _mm_loadu_si128((const __m128i*)(bottom + x + 4)));
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(3, 1, 3, 1)));
+    _mm_storeu_si128((__m128i*)(dst + x / 2), _mm_avg_epu8(even, odd));
+  }
+  halveRowScalar(dst + x / 2, top + x, bottom + x, width - x);
+}
+#endif
+
+static HalveKernel selectHalveKernel()
+{
+#ifdef PIXELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    return halveRowSSE2;
+#endif
+  return halveRowScalar;
+}
+
+static void halveLevel(MipLevel const& src, MipLevel *dst)
+{
+  static const HalveKernel kernel = selectHalveKernel();
+
+  dst->width = (src.width + 1) / 2;
+  dst->height = (src.height + 1) / 2;
+  dst->pixels.resize((size_t)dst->width * dst->height);
+  for (int y = 0; y < dst->height; y++)
+  {
+    /* An odd last row or column is averaged with itself. */
+    const uint32_t *top = src.pixels.data() + (size_t)(2 * y) * src.width;
+    const uint32_t *bottom = 2 * y + 1 < src.height ? top + src.width : top;
+    uint32_t *row = dst->pixels.data() + (size_t)y * dst->width;
+    kernel(row, top, bottom, src.width);
+    if (src.width & 1)
+      row[dst->width - 1] = average4(top[src.width - 1], top[src.width - 1], bottom[src.width - 1], bottom[src.width - 1]);
+  }
+}
+
+void buildMipPyramid(MipPyramid *pyramid, const unsigned char *pixels, int pitch, int width, int height)
+{
+  pyramid->levels.resize(1);
+  MipLevel *base = &pyramid->levels[0];
+  base->width = width;
+  base->height = height;
+  base->pixels.resize((size_t)width * height);
+  copyPixelsOpaque((unsigned char*)base->pixels.data(), width * 4, pixels, pitch, width, height);
+
+  while (pyramid->levels.back().width > 2 && pyramid->levels.back().height > 2)
+  {
+    MipLevel level;
+    halveLevel(pyramid->levels.back(), &level);
+    pyramid->levels.push_back(std::move(level));
+  }
+}
+
+/* Source position and 8 bit weight of the right (or lower) neighbour for one
+ * destination column (or row). index is -1 outside the level. */
+typedef struct _Tap {
+  int index;
+  uint32_t weight;
+} Tap;
+
+static void computeTaps(std::vector<Tap> *taps, int count, double origin, double step, int size)
+{
+  taps->resize(count);
+  for (int i = 0; i < count; i++)
+  {
+    double position = origin + (i + 0.5) * step;
+    Tap *tap = &(*taps)[i];
+    if (position < 0 || position >= size)
+    {
+      tap->index = -1;
+      continue;
+    }
+    /* Bilinear taps are between pixel centers; clamp at the edges so the
+     * pair [index, index + 1] is always inside the level. */
+    double center = position - 0.5;
+    if (size < 2 || center <= 0)
+      tap->index = 0, tap->weight = 0;
+    else if (center >= size - 1)
+      tap->index = size - 2, tap->weight = 256;
+    else
+    {
+      tap->index = (int)center;
+      tap->weight = (uint32_t)((center - tap->index) * 256 + 0.5);
+    }
+  }
+}
+
+static uint32_t lerpPixel(uint32_t a, uint32_t b, uint32_t weight)
+{
+  uint32_t result = 0;
+  for (int shift = 0; shift < 32; shift += 8)
+  {
+    uint32_t ca = (a >> shift) & 0xff, cb = (b >> shift) & 0xff;
+    result |= ((ca * (256 - weight) + cb * weight) >> 8) << shift;
+  }
+  return result;
+}
+
+typedef void (*BilinearKernel)(uint32_t *dst, const uint32_t *top, const uint32_t *bottom, uint32_t fy,
+                               const Tap *taps, int width, int level_width);
+
+static void bilinearRowScalar(uint32_t *dst, const uint32_t *top, const uint32_t *bottom, uint32_t fy,
+                              const Tap *taps, int width, int level_width)
+{
+  for (int x = 0; x < width; x++)
+  {
+    Tap tap = taps[x];
+    if (tap.index < 0)
+    {
+      dst[x] = 0xffffffff;
+      continue;
+    }
+    /* Rows first, like the SSE2 kernel, so both round the same way. */
+    int right = level_width > 1 ? tap.index + 1 : tap.index;
+    uint32_t left = lerpPixel(top[tap.index], bottom[tap.index], fy);
+    uint32_t right_column = lerpPixel(top[right], bottom[right], fy);
+    dst[x] = lerpPixel(left, right_column, tap.weight);
+  }
+}
+
+#ifdef PIXELS_X86
+/* One pixel per step with all four channels of both horizontal neighbours in
+ * 16 bit lanes: blend the two rows, then fold the right neighbour onto the
+ * left one. Sums stay below 65536, so unsigned 16 bit arithmetic is exact. */
+static void bilinearRowSSE2(uint32_t *dst, const uint32_t *top, const uint32_t *bottom, uint32_t fy,
+                            const Tap *taps, int width, int level_width)
+{
+  if (level_width < 2)
+  {
+    bilinearRowScalar(dst, top, bottom, fy, taps, width, level_width);
+    return;
+  }
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i wy_top = _mm_set1_epi16((short)(256 - fy));
+  const __m128i wy_bottom = _mm_set1_epi16((short)fy);
+  for (int x = 0; x < width; x++)
+  {
+    Tap tap = taps[x];
+    if (tap.index < 0)
+    {
+      dst[x] = 0xffffffff;
+      continue;
+    }
+    __m128i upper = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(top + tap.index)), zero);
+    __m128i lower = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(bottom + tap.index)), zero);
+    __m128i column = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(upper, wy_top), _mm_mullo_epi16(lower, wy_bottom)), 8);
+    short wx = (short)tap.weight, wl = (short)(256 - tap.weight);
+    __m128i weighted = _mm_mullo_epi16(column, _mm_set_epi16(wx, wx, wx, wx, wl, wl, wl, wl));
+    __m128i sum = _mm_srli_epi16(_mm_add_epi16(weighted, _mm_srli_si128(weighted, 8)), 8);
+    dst[x] = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+  }
+}
+#endif
+
+static BilinearKernel selectBilinearKernel()
+{
+#ifdef PIXELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    return bilinearRowSSE2;
+#endif
+  return bilinearRowScalar;
+}
+
+void sampleMipPyramid(MipPyramid *pyramid, double x0, double y0, double scale_x, double scale_y,
+                      unsigned char *pixels, int pitch, int width, int height)
+{
+  static const BilinearKernel kernel = selectBilinearKernel();
+
+  if (pyramid->levels.empty())
+    return;
+
+  /* Each halving is only worth it once at least two source pixels fall on a
+   * window pixel. */
+  double scale = scale_x < scale_y ? scale_x : scale_y;
+  size_t index = 0;
+  while (index + 1 < pyramid->levels.size() && scale * (1 << (index + 1)) <= 1.0)
+    index++;
+  MipLevel const& level = pyramid->levels[index];
+  double level_scale = 1.0 / (1 << index);
+
+  std::vector<Tap> columns, rows;
+  computeTaps(&columns, width, x0 * level_scale, level_scale / scale_x, level.width);
+  computeTaps(&rows, height, y0 * level_scale, level_scale / scale_y, level.height);
+
+  for (int y = 0; y < height; y++)
+  {
+    uint32_t *dst = (uint32_t*)(pixels + (size_t)y * pitch);
+    Tap row = rows[y];
+    if (row.index < 0)
+    {
+      memset(dst, 0xff, (size_t)width * 4);
+      continue;
+    }
+    const uint32_t *top = level.pixels.data() + (size_t)row.index * level.width;
+    const uint32_t *bottom = level.height > 1 ? top + level.width : top;
+    kernel(dst, top, bottom, row.weight, columns.data(), width, level.width);
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef PIXELS_H
+#define PIXELS_H
+
+#include <cstdint>
+#include <vector>
+
+/* Copies a width x height block of 32 bit pixels and forces every alpha byte
+ * to 0xff, turning a cairo RGB24 frame (whose fourth byte is undefined) into
+ * an opaque 4 channel image. Byte order is kept, so the result can be scaled
+ * straight back into the window surface. Pitches are in bytes. Uses AVX2 or
+ * SSE2 when the CPU has them. */
+void copyPixelsOpaque(unsigned char *dst, int dst_pitch, const unsigned char *src, int src_pitch, int width, int height);
+
+typedef struct _MipLevel {
+  int width;
+  int height;
+  std::vector<uint32_t> pixels;
+} MipLevel;
+
+/* A frozen frame and its successive 2x2 box filtered halvings, level 0 being
+ * the frame itself. */
+typedef struct _MipPyramid {
+  std::vector<MipLevel> levels;
+} MipPyramid;
+
+/* Captures a frame (made opaque, see copyPixelsOpaque) and builds every
+ * level down to a couple of pixels. */
+void buildMipPyramid(MipPyramid *pyramid, const unsigned char *pixels, int pitch, int width, int height);
+
+/* Fills a width x height window with the frame scaled by (scale_x, scale_y)
+ * so that frame point (x0, y0) lands on the top left corner. Zooming out
+ * samples the level closest to the scale, zooming in filters level 0
+ * bilinearly. Anything outside the frame is white. */
+void sampleMipPyramid(MipPyramid *pyramid, double x0, double y0, double scale_x, double scale_y,
+                      unsigned char *pixels, int pitch, int width, int height);
+
+#endif
@@ -0,0 +1,177 @@
+#include <algorithm>
+
+#include <SDL2/SDL.h>
+#include <core/SkCanvas.h>
+#include <core/SkSurface.h>
+
+#include "render-worker.h"
+#include "trace.h"
+
+/* Rows rendered between two checks for a newer generation. */
+#define BAND_HEIGHT 64
+
+static void releaseSource(TileSource *source)
+{
+  if (source->cairo_recording)
+    cairo_surface_destroy(source->cairo_recording);
+  source->cairo_recording = NULL;
+  source->skia_picture.reset();
+}
+
+static void renderBand(TileSource *source, RenderView const& view, uint32_t *pixels, int top, int rows)
+{
+  uint32_t *band = pixels + (size_t)top * view.width;
+  if (source->cairo_recording)
+  {
+    cairo_surface_t *surface = cairo_image_surface_create_for_data((unsigned char*)band, CAIRO_FORMAT_RGB24,
+                                                                   view.width, rows, view.width * 4);
+    cairo_t *cr = cairo_create(surface);
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_paint(cr);
+    cairo_translate(cr, 0, -top);
+    cairo_scale(cr, view.scale_x, view.scale_y);
+    cairo_translate(cr, -view.x0, -view.y0);
+    cairo_set_source_surface(cr, source->cairo_recording, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+    cairo_surface_destroy(surface);
+    return;
+  }
+
+  SkImageInfo info = SkImageInfo::Make(view.width, rows, kBGRA_8888_SkColorType, kOpaque_SkAlphaType, nullptr);
+  sk_sp<SkSurface> surface = SkSurface::MakeRasterDirect(info, band, view.width * 4, nullptr);
+  SkCanvas *canvas = surface->getCanvas();
+  canvas->clear(SK_ColorWHITE);
+  canvas->translate(0, -top);
+  canvas->scale(view.scale_x, view.scale_y);
+  canvas->translate(-view.x0, -view.y0);
+  canvas->drawPicture(source->skia_picture.get());
+}
+
+static void workerLoop(RenderWorker *worker)
+{
+  traceSetThreadName("render worker");
+  RenderFrame frame;
+  while (1)
+  {
+    TileSource source;
+    {
+      std::unique_lock<std::mutex> lock(worker->mutex);
+      worker->wake.wait(lock, [&]() { return worker->quit || worker->has_job; });
+      if (worker->quit)
+        return;
+      source = worker->source;
+      worker->source.cairo_recording = NULL;
+      worker->source.skia_picture.reset();
+      frame.view = worker->view;
+      frame.generation = worker->job_generation;
+      worker->has_job = false;
+    }
+
+    TRACE_SCOPE("renderJob");
+    frame.pixels.resize((size_t)frame.view.width * frame.view.height);
+    bool superseded = false;
+    for (int top = 0; top < frame.view.height && !superseded; top += BAND_HEIGHT)
+    {
+      int rows = std::min(BAND_HEIGHT, frame.view.height - top);
+      renderBand(&source, frame.view, frame.pixels.data(), top, rows);
+      superseded = worker->latest.load() != frame.generation;
+    }
+    releaseSource(&source);
+    if (superseded)
+      continue;
+
+    {
+      std::lock_guard<std::mutex> lock(worker->mutex);
+      std::swap(worker->result, frame);
+      worker->has_result = true;
+    }
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = worker->event_type;
+    SDL_PushEvent(&event);
+  }
+}
+
+void startRenderWorker(RenderWorker *worker, uint32_t event_type)
+{
+  worker->quit = false;
+  worker->has_job = false;
+  worker->source.cairo_recording = NULL;
+  worker->job_generation = 0;
+  worker->latest = 0;
+  worker->has_result = false;
+  worker->copied_from = NULL;
+  worker->copy = NULL;
+  worker->event_type = event_type;
+  worker->thread = std::thread(workerLoop, worker);
+}
+
+void stopRenderWorker(RenderWorker *worker)
+{
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->quit = true;
+    /* Makes a job in flight stop at its next band. */
+    worker->latest++;
+    releaseSource(&worker->source);
+  }
+  worker->wake.notify_one();
+  worker->thread.join();
+  if (worker->copied_from)
+  {
+    cairo_surface_destroy(worker->copied_from);
+    cairo_surface_destroy(worker->copy);
+  }
+  worker->copied_from = NULL;
+  worker->copy = NULL;
+}
+
+uint64_t submitRenderJob(RenderWorker *worker, TileSource *source, RenderView view)
+{
+  /* The reference on copied_from keeps its address from being reused by a
+   * later recording. */
+  if (source->cairo_recording && source->cairo_recording != worker->copied_from)
+  {
+    if (worker->copied_from)
+    {
+      cairo_surface_destroy(worker->copied_from);
+      cairo_surface_destroy(worker->copy);
+    }
+    worker->copied_from = cairo_surface_reference(source->cairo_recording);
+    worker->copy = copyCairoRecording(source->cairo_recording);
+  }
+
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    releaseSource(&worker->source);
+    worker->source.cairo_recording = source->cairo_recording ? cairo_surface_reference(worker->copy) : NULL;
+    worker->source.skia_picture = source->skia_picture;
+    worker->view = view;
+    generation = ++worker->job_generation;
+    worker->latest = generation;
+    worker->has_job = true;
+  }
+  worker->wake.notify_one();
+  return generation;
+}
+
+void cancelRenderJob(RenderWorker *worker)
+{
+  std::lock_guard<std::mutex> lock(worker->mutex);
+  releaseSource(&worker->source);
+  worker->has_job = false;
+  worker->latest = ++worker->job_generation;
+}
+
+bool takeRenderFrame(RenderWorker *worker, RenderFrame *frame)
+{
+  std::lock_guard<std::mutex> lock(worker->mutex);
+  if (!worker->has_result)
+    return false;
+  std::swap(*frame, worker->result);
+  worker->has_result = false;
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef RENDER_WORKER_H
+#define RENDER_WORKER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "tiles.h"
+
+/* Where a frame looks: document point (x0, y0) on the top left pixel, scaled
+ * by (scale_x, scale_y). owner identifies the recording it shows. */
+typedef struct _RenderView {
+  const void *owner;
+  double x0;
+  double y0;
+  double scale_x;
+  double scale_y;
+  int width;
+  int height;
+} RenderView;
+
+typedef struct _RenderFrame {
+  uint64_t generation;
+  RenderView view;
+  std::vector<uint32_t> pixels;
+} RenderFrame;
+
+/* A thread that rasterizes recordings off the UI thread. Every submitted
+ * job gets the next generation, and a job gives up between bands as soon
+ * as a newer generation exists, so only the latest view is ever finished. */
+typedef struct _RenderWorker {
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool quit;
+  bool has_job;
+  TileSource source;
+  RenderView view;
+  uint64_t job_generation;
+  std::atomic<uint64_t> latest;
+  bool has_result;
+  RenderFrame result;
+  /* The worker's own copy of the last Cairo recording submitted, so that it
+   * never replays one the UI thread may be replaying. Both are only touched
+   * by the submitting thread. */
+  cairo_surface_t *copied_from;
+  cairo_surface_t *copy;
+  /* SDL event pushed whenever a frame completes, to wake the event loop. */
+  uint32_t event_type;
+} RenderWorker;
+
+void startRenderWorker(RenderWorker *worker, uint32_t event_type);
+void stopRenderWorker(RenderWorker *worker);
+
+/* Replaces any pending job and returns its generation. The worker keeps its
+ * own reference to the recording. A Cairo recording is copied the first time
+ * it is submitted and the worker replays the copy. */
+uint64_t submitRenderJob(RenderWorker *worker, TileSource *source, RenderView view);
+
+/* Drops any pending job and makes the one in flight stop at its next band,
+ * without starting another. */
+void cancelRenderJob(RenderWorker *worker);
+
+/* Moves the newest completed frame into *frame. Returns false if no frame
+ * completed since the last call. */
+bool takeRenderFrame(RenderWorker *worker, RenderFrame *frame);
+
+#endif
@@ -0,0 +1,235 @@
+#include <cmath>
+#include <cstring>
+
+#include <core/SkCanvas.h>
+#include <core/SkSurface.h>
+
+#include "tiles.h"
+#include "trace.h"
+
+static uint64_t tileHash(TileKey key)
+{
+  return ((uint64_t)(uint16_t)key.level << 48) |
+         ((uint64_t)(uint32_t)(key.tx & 0xffffff) << 24) |
+         (uint64_t)(uint32_t)(key.ty & 0xffffff);
+}
+
+static void tileHelper(TileCache *cache, int helper);
+
+void initializeTileCache(TileCache *cache, size_t capacity, int threads)
+{
+  cache->capacity = capacity;
+  cache->threads = threads < 1 ? 1 : threads;
+  cache->rendered = 0;
+  cache->quit = false;
+  cache->batch = 0;
+  cache->busy = 0;
+  cache->copied_from = NULL;
+  clearTileCache(cache);
+  for (int i = 1; i < cache->threads; i++)
+    cache->pool.push_back(std::thread(tileHelper, cache, i - 1));
+}
+
+static void releaseCopies(TileCache *cache)
+{
+  if (cache->copied_from)
+    cairo_surface_destroy(cache->copied_from);
+  cache->copied_from = NULL;
+  for (cairo_surface_t *copy: cache->copies)
+    cairo_surface_destroy(copy);
+  cache->copies.clear();
+}
+
+void clearTileCache(TileCache *cache)
+{
+  cache->tiles.clear();
+  cache->index.clear();
+  releaseCopies(cache);
+}
+
+void destroyTileCache(TileCache *cache)
+{
+  {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->quit = true;
+  }
+  cache->wake.notify_all();
+  for (auto& thread: cache->pool)
+    thread.join();
+  cache->pool.clear();
+  clearTileCache(cache);
+}
+
+static void renderTileCairo(cairo_surface_t *recording, Tile *tile, double scale)
+{
+  cairo_surface_t *surface = cairo_image_surface_create_for_data((unsigned char*)tile->pixels.data(),
+                                                                 CAIRO_FORMAT_RGB24,
+                                                                 TILE_SIZE, TILE_SIZE,
+                                                                 TILE_SIZE * 4);
+  cairo_t *cr = cairo_create(surface);
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+  cairo_paint(cr);
+  cairo_translate(cr, -1.0 * tile->key.tx * TILE_SIZE, -1.0 * tile->key.ty * TILE_SIZE);
+  cairo_scale(cr, scale, scale);
+  cairo_set_source_surface(cr, recording, 0, 0);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(surface);
+  cairo_surface_destroy(surface);
+}
+
+static void renderTileSkia(SkPicture *picture, Tile *tile, double scale)
+{
+  SkImageInfo info = SkImageInfo::Make(TILE_SIZE, TILE_SIZE, kBGRA_8888_SkColorType, kOpaque_SkAlphaType, nullptr);
+  sk_sp<SkSurface> surface = SkSurface::MakeRasterDirect(info, tile->pixels.data(), TILE_SIZE * 4, nullptr);
+  SkCanvas *canvas = surface->getCanvas();
+  canvas->clear(SK_ColorWHITE);
+  canvas->translate(-1.0f * tile->key.tx * TILE_SIZE, -1.0f * tile->key.ty * TILE_SIZE);
+  canvas->scale(scale, scale);
+  canvas->drawPicture(picture);
+}
+
+/* Renders tiles of the posted batch until none are left. `recording` is the
+ * calling thread's own one. */
+static void renderJobs(TileCache *cache, cairo_surface_t *recording)
+{
+  while (1)
+  {
+    size_t i = cache->next.fetch_add(1);
+    if (i >= cache->jobs->size())
+      break;
+    TRACE_SCOPE("renderTile");
+    if (recording)
+      renderTileCairo(recording, (*cache->jobs)[i], cache->scale);
+    else
+      renderTileSkia(cache->source->skia_picture.get(), (*cache->jobs)[i], cache->scale);
+  }
+}
+
+static void tileHelper(TileCache *cache, int helper)
+{
+  traceSetThreadName("tile helper");
+  uint64_t seen = 0;
+  while (1)
+  {
+    {
+      std::unique_lock<std::mutex> lock(cache->mutex);
+      cache->wake.wait(lock, [&]() { return cache->quit || cache->batch != seen; });
+      if (cache->quit)
+        return;
+      seen = cache->batch;
+    }
+    renderJobs(cache, cache->source->cairo_recording ? cache->copies[helper] : NULL);
+    {
+      std::lock_guard<std::mutex> lock(cache->mutex);
+      cache->busy--;
+    }
+    cache->done.notify_one();
+  }
+}
+
+static void renderTiles(TileCache *cache, TileSource *source, std::vector<Tile*> *jobs, double scale)
+{
+  /* Copies are made here, on the thread that owns the recording, and kept
+   * until the recording changes. The reference on copied_from keeps its
+   * address from being reused by a later recording. */
+  if (source->cairo_recording && source->cairo_recording != cache->copied_from)
+  {
+    releaseCopies(cache);
+    cache->copied_from = cairo_surface_reference(source->cairo_recording);
+    for (size_t i = 0; i < cache->pool.size(); i++)
+      cache->copies.push_back(copyCairoRecording(source->cairo_recording));
+  }
+
+  cache->source = source;
+  cache->jobs = jobs;
+  cache->scale = scale;
+  cache->next = 0;
+  /* A single tile isn't worth waking anyone for. */
+  if (jobs->size() > 1 && !cache->pool.empty())
+  {
+    {
+      std::lock_guard<std::mutex> lock(cache->mutex);
+      cache->busy = cache->pool.size();
+      cache->batch++;
+    }
+    cache->wake.notify_all();
+  }
+  renderJobs(cache, source->cairo_recording);
+  std::unique_lock<std::mutex> lock(cache->mutex);
+  cache->done.wait(lock, [&]() { return cache->busy == 0; });
+}
+
+cairo_surface_t *copyCairoRecording(cairo_surface_t *recording)
+{
+  cairo_surface_t *copy = cairo_recording_surface_create(cairo_surface_get_content(recording), NULL);
+  cairo_recording_surface_replay(recording, copy);
+  return copy;
+}
+
+void drawTiles(TileCache *cache, TileSource *source, double x0, double y0, double scale,
+               unsigned char *pixels, int width, int height, int pitch)
+{
+  int level = (int)lround(log(scale) / log(1.25));
+  double tile_scale = pow(1.25, level);
+
+  /* The viewport origin snapped to whole device pixels at this level. */
+  long origin_x = (long)floor(x0 * tile_scale);
+  long origin_y = (long)floor(y0 * tile_scale);
+  int tx0 = (int)floor((double)origin_x / TILE_SIZE);
+  int ty0 = (int)floor((double)origin_y / TILE_SIZE);
+  int tx1 = (int)floor((double)(origin_x + width - 1) / TILE_SIZE);
+  int ty1 = (int)floor((double)(origin_y + height - 1) / TILE_SIZE);
+
+  std::vector<Tile*> visible;
+  std::vector<Tile*> jobs;
+  for (int ty = ty0; ty <= ty1; ty++)
+  {
+    for (int tx = tx0; tx <= tx1; tx++)
+    {
+      TileKey key = {level, tx, ty};
+      uint64_t hash = tileHash(key);
+      auto found = cache->index.find(hash);
+      if (found != cache->index.end())
+      {
+        cache->tiles.splice(cache->tiles.begin(), cache->tiles, found->second);
+        visible.push_back(&cache->tiles.front());
+        continue;
+      }
+      cache->tiles.push_front(Tile());
+      Tile *tile = &cache->tiles.front();
+      tile->key = key;
+      tile->pixels.resize(TILE_SIZE * TILE_SIZE);
+      cache->index[hash] = cache->tiles.begin();
+      visible.push_back(tile);
+      jobs.push_back(tile);
+    }
+  }
+
+  cache->rendered = jobs.size();
+  if (!jobs.empty())
+    renderTiles(cache, source, &jobs, tile_scale);
+
+  for (Tile *tile: visible)
+  {
+    long left = (long)tile->key.tx * TILE_SIZE - origin_x;
+    long top = (long)tile->key.ty * TILE_SIZE - origin_y;
+    long col0 = left < 0 ? -left : 0;
+    long col1 = left + TILE_SIZE > width ? width - left : TILE_SIZE;
+    long row0 = top < 0 ? -top : 0;
+    long row1 = top + TILE_SIZE > height ? height - top : TILE_SIZE;
+    for (long row = row0; row < row1; row++)
+    {
+      memcpy(pixels + (top + row) * pitch + (left + col0) * 4,
+             tile->pixels.data() + row * TILE_SIZE + col0,
+             (col1 - col0) * 4);
+    }
+  }
+
+  /* Evict least recently used tiles, never ones on screen. */
+  while (cache->tiles.size() > cache->capacity && cache->tiles.size() > visible.size())
+  {
+    cache->index.erase(tileHash(cache->tiles.back().key));
+    cache->tiles.pop_back();
+  }
+}
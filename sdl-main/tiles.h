@@ -0,0 +1,87 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include <cairo.h>
+#include <core/SkPicture.h>
+
+#define TILE_SIZE 256
+
+/* A recorded document to rasterize tiles from. Exactly one of the two is set. */
+typedef struct _TileSource {
+  cairo_surface_t *cairo_recording;
+  sk_sp<SkPicture> skia_picture;
+} TileSource;
+
+/* Zoom level is the power of 1.25 the document is scaled by, which is exactly
+ * what zoomInTransform/zoomOutTransform step through. Tile (tx, ty) covers
+ * device pixels [tx * TILE_SIZE, (tx + 1) * TILE_SIZE) of the document scaled
+ * to that level. */
+typedef struct _TileKey {
+  int level;
+  int tx;
+  int ty;
+} TileKey;
+
+typedef struct _Tile {
+  TileKey key;
+  std::vector<uint32_t> pixels;
+} Tile;
+
+typedef struct _TileCache {
+  size_t capacity;
+  int threads;
+  /* Most recently used tile first. */
+  std::list<Tile> tiles;
+  std::unordered_map<uint64_t, std::list<Tile>::iterator> index;
+  /* Number of tiles rasterized for the last frame, for the info box. */
+  int rendered;
+
+  /* threads - 1 helpers, started once, that join the drawing thread on each
+   * batch of tiles. A batch is posted by bumping `batch` and is over when
+   * `busy` is back to zero. */
+  std::vector<std::thread> pool;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool quit;
+  uint64_t batch;
+  int busy;
+  TileSource *source;
+  std::vector<Tile*> *jobs;
+  double scale;
+  std::atomic<size_t> next;
+  /* Helper i replays copies[i] of the Cairo recording copied_from, so no
+   * two threads replay one recording. The drawing thread uses the original. */
+  cairo_surface_t *copied_from;
+  std::vector<cairo_surface_t*> copies;
+} TileCache;
+
+/* A new recording with the same commands, for a thread that must not replay
+ * `recording` while another thread might. Make it on the thread that owns
+ * `recording`. */
+cairo_surface_t *copyCairoRecording(cairo_surface_t *recording);
+
+/* Starts the helper threads, which run until destroyTileCache. */
+void initializeTileCache(TileCache *cache, size_t capacity, int threads);
+/* Forgets the tiles and the helpers' copies of the last recording. */
+void clearTileCache(TileCache *cache);
+void destroyTileCache(TileCache *cache);
+
+/* Fills a width x height xRGB buffer with the document scaled by `scale` and
+ * panned so that document point (x0, y0) lands on the top left pixel. Tiles
+ * that aren't cached are rendered in parallel, each thread with its own
+ * surface and context clipped to the tile. Skia pictures are immutable and
+ * shared by all threads. */
+void drawTiles(TileCache *cache, TileSource *source, double x0, double y0, double scale,
+               unsigned char *pixels, int width, int height, int pitch);
+
+#endif
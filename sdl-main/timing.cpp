@@ -0,0 +1,132 @@
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include "timing.h"
+
+void initializeStageTimings(StageTimings *timings, const char *csv_path)
+{
+  for (int s = 0; s < STAGE_COUNT; s++)
+    timings->current[s] = 0;
+  timings->depth = 0;
+  timings->mark = timingNow();
+  timings->frames = 0;
+  timings->total_frames = 0;
+  timings->csv = NULL;
+  if (!csv_path)
+    return;
+
+  timings->csv = fopen(csv_path, "w");
+  if (!timings->csv)
+  {
+    fprintf(stderr, "could not open %s for writing\n", csv_path);
+    return;
+  }
+  fprintf(timings->csv, "frame,label");
+  for (int s = 0; s < STAGE_COUNT; s++)
+    fprintf(timings->csv, ",%s_ms", stageName((Stage)s));
+  fprintf(timings->csv, "\n");
+}
+
+void closeStageTimings(StageTimings *timings)
+{
+  if (timings->csv)
+    fclose(timings->csv);
+  timings->csv = NULL;
+}
+
+double timingNow()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Charges the time since the last mark to the innermost open stage. */
+static void chargeOpenStage(StageTimings *timings)
+{
+  double now = timingNow();
+  if (timings->depth > 0)
+    timings->current[timings->open[timings->depth - 1]] += now - timings->mark;
+  timings->mark = now;
+}
+
+void beginStage(StageTimings *timings, Stage stage)
+{
+  chargeOpenStage(timings);
+  if (timings->depth < MAX_STAGE_DEPTH)
+    timings->open[timings->depth] = stage;
+  timings->depth++;
+}
+
+void endStage(StageTimings *timings)
+{
+  if (timings->depth <= MAX_STAGE_DEPTH)
+    chargeOpenStage(timings);
+  else
+    timings->mark = timingNow();
+  if (timings->depth > 0)
+    timings->depth--;
+}
+
+void addStageTime(StageTimings *timings, Stage stage, double ms)
+{
+  timings->current[stage] += ms;
+}
+
+void finishTimedFrame(StageTimings *timings, const char *label)
+{
+  double *row = timings->history[timings->total_frames % TIMING_WINDOW];
+  for (int s = 0; s < STAGE_COUNT; s++)
+  {
+    row[s] = timings->current[s];
+    timings->current[s] = 0;
+  }
+  if (timings->frames < TIMING_WINDOW)
+    timings->frames++;
+
+  if (timings->csv)
+  {
+    fprintf(timings->csv, "%lu,%s", (unsigned long)timings->total_frames, label);
+    for (int s = 0; s < STAGE_COUNT; s++)
+      fprintf(timings->csv, ",%.3f", row[s]);
+    fprintf(timings->csv, "\n");
+    fflush(timings->csv);
+  }
+  timings->total_frames++;
+}
+
+const char *stageName(Stage stage)
+{
+  switch (stage)
+  {
+    case STAGE_READ: return "read";
+    case STAGE_PARSE: return "parse";
+    case STAGE_RENDER: return "render";
+    case STAGE_BBOX: return "bbox";
+    case STAGE_OVERLAY: return "overlay";
+    case STAGE_PRESENT: return "present";
+    default: break;
+  }
+  return "unknown";
+}
+
+double stageAverage(StageTimings *timings, Stage stage)
+{
+  if (timings->frames == 0)
+    return 0;
+  double sum = 0;
+  for (int i = 0; i < timings->frames; i++)
+    sum += timings->history[i][stage];
+  return sum / timings->frames;
+}
+
+double stageP95(StageTimings *timings, Stage stage)
+{
+  if (timings->frames == 0)
+    return 0;
+  std::vector<double> values(timings->frames);
+  for (int i = 0; i < timings->frames; i++)
+    values[i] = timings->history[i][stage];
+  size_t index = (size_t)(0.95 * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
@@ -0,0 +1,54 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <cstdio>
+#include <cstdint>
+
+typedef enum _Stage {
+  STAGE_READ = 0,
+  STAGE_PARSE = 1,
+  STAGE_RENDER = 2,
+  STAGE_BBOX = 3,
+  STAGE_OVERLAY = 4,
+  STAGE_PRESENT = 5,
+  STAGE_COUNT = 6
+} Stage;
+
+/* Frames the rolling statistics are computed over. */
+#define TIMING_WINDOW 120
+#define MAX_STAGE_DEPTH 8
+
+/* Per-stage milliseconds of the frame being drawn and of the last
+ * TIMING_WINDOW frames. Stages nest, and time always goes to the innermost
+ * open stage, so a bbox computed while rendering isn't counted twice. */
+typedef struct _StageTimings {
+  double current[STAGE_COUNT];
+  Stage open[MAX_STAGE_DEPTH];
+  int depth;
+  double mark;
+  double history[TIMING_WINDOW][STAGE_COUNT];
+  int frames;
+  uint64_t total_frames;
+  FILE *csv;
+} StageTimings;
+
+/* csv_path may be NULL. Otherwise every frame is appended to it. */
+void initializeStageTimings(StageTimings *timings, const char *csv_path);
+void closeStageTimings(StageTimings *timings);
+
+/* Monotonic milliseconds. */
+double timingNow();
+
+void beginStage(StageTimings *timings, Stage stage);
+void endStage(StageTimings *timings);
+void addStageTime(StageTimings *timings, Stage stage, double ms);
+
+/* Closes the frame: moves it into the rolling window and the CSV, tagged
+ * with `label` (renderer, engine and mode). */
+void finishTimedFrame(StageTimings *timings, const char *label);
+
+const char *stageName(Stage stage);
+double stageAverage(StageTimings *timings, Stage stage);
+double stageP95(StageTimings *timings, Stage stage);
+
+#endif